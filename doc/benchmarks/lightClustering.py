@@ -0,0 +1,243 @@
+#!/usr/bin/env python
+# Copyright 2019 Intel Corporation
+# SPDX-License-Identifier: Apache-2.0
+
+"""Times interactive rendering of a scene with many sphere lights.
+
+Writes a stage with a ground plane and a grid of colored sphere lights,
+then orbits the camera around it with HdOSPRay, once with the lightClustering
+render setting disabled and once with it enabled, and prints the time per
+rendered viewport update.  Every update moves the camera, which is the case
+light clustering targets.
+
+Faster updates only help if the image is not noisier or more biased, so the
+convergence of the interactive frames is measured as well.  At a few views of
+the orbit a reference is accumulated with all lights and the camera at rest.
+The camera then keeps moving by a negligible amount, so HdOSPRay renders
+interactive frames, and the displayed frames are averaged until their mean
+squared error against the reference drops below --noise.  The render time
+until then is printed per view, views that do not reach the noise level
+within --max-seconds, for example because clustering biases them, are
+reported with their final error.
+
+    python lightClustering.py --lights 4096 --updates 200 --noise 1e-4
+
+Requires the USD Python modules, numpy, PySide2 or PySide6 for an offscreen
+OpenGL context, and HdOSPRay on the plugin path.
+"""
+
+import argparse
+import math
+import random
+import time
+
+import numpy
+from pxr import Gf, Sdf, Usd, UsdGeom, UsdImagingGL, UsdLux
+
+try:
+    from PySide6.QtGui import QGuiApplication, QImage, QOffscreenSurface
+    from PySide6.QtGui import QOpenGLContext, QSurfaceFormat
+    from PySide6.QtOpenGL import QOpenGLFramebufferObject
+    from PySide6.QtOpenGL import QOpenGLFramebufferObjectFormat
+except ImportError:
+    from PySide2.QtGui import QGuiApplication, QImage, QOffscreenSurface
+    from PySide2.QtGui import QOpenGLContext, QSurfaceFormat
+    from PySide2.QtGui import QOpenGLFramebufferObject
+    from PySide2.QtGui import QOpenGLFramebufferObjectFormat
+
+
+def create_stage(path, num_lights, size, seed):
+    """Ground plane of size x size with a grid of sphere lights above it."""
+    stage = Usd.Stage.CreateNew(path)
+    UsdGeom.SetStageUpAxis(stage, UsdGeom.Tokens.y)
+
+    ground = UsdGeom.Mesh.Define(stage, "/World/ground")
+    half = 0.5 * size
+    ground.CreatePointsAttr([(-half, 0, -half), (half, 0, -half),
+                             (half, 0, half), (-half, 0, half)])
+    ground.CreateFaceVertexCountsAttr([4])
+    ground.CreateFaceVertexIndicesAttr([0, 3, 2, 1])
+
+    rng = random.Random(seed)
+    side = int(math.ceil(math.sqrt(num_lights)))
+    spacing = size / side
+    for i in range(num_lights):
+        light = UsdLux.SphereLight.Define(
+            stage, "/World/lights/light_%d" % i)
+        x = -half + spacing * (i % side + 0.5)
+        z = -half + spacing * (i // side + 0.5)
+        UsdGeom.Xformable(light).AddTranslateOp().Set(
+            Gf.Vec3d(x, 0.5 * spacing, z))
+        light.CreateRadiusAttr(0.05 * spacing)
+        light.CreateIntensityAttr(50.0)
+        light.CreateColorAttr(Gf.Vec3f(rng.uniform(0.2, 1.0),
+                                       rng.uniform(0.2, 1.0),
+                                       rng.uniform(0.2, 1.0)))
+    stage.GetRootLayer().Save()
+    return stage
+
+
+def render_params():
+    params = UsdImagingGL.RenderParams()
+    params.clearColor = Gf.Vec4f(0, 0, 0, 1)
+    return params
+
+
+def set_camera(engine, width, height, size, angle, offset=0.0):
+    """Looks at the scene center from the orbit position at angle, moved
+    upwards by offset."""
+    frustum = Gf.Frustum()
+    frustum.SetPerspective(60.0, float(width) / height, 0.1, 10.0 * size)
+    eye = Gf.Vec3d(0.6 * size * math.cos(angle), 0.25 * size + offset,
+                   0.6 * size * math.sin(angle))
+    view = Gf.Matrix4d().SetLookAt(eye, Gf.Vec3d(0), Gf.Vec3d(0, 1, 0))
+    engine.SetRenderViewport(Gf.Vec4d(0, 0, width, height))
+    engine.SetCameraState(view, frustum.ComputeProjectionMatrix())
+
+
+def read_image(fbo):
+    """Displayed image of the framebuffer as float RGB array."""
+    image = fbo.toImage().convertToFormat(QImage.Format_RGBA8888)
+    pixels = numpy.frombuffer(bytes(image.constBits()), numpy.uint8)
+    pixels = pixels.reshape(image.height(), image.width(), 4)
+    return pixels[:, :, :3].astype(numpy.float64) / 255.0
+
+
+def orbit(engine, stage, width, height, size, updates):
+    """Renders one viewport update per camera position, returns the
+    seconds of each update."""
+    params = render_params()
+    times = []
+    for i in range(updates):
+        set_camera(engine, width, height, size, 2.0 * math.pi * i / updates)
+        start = time.perf_counter()
+        engine.Render(stage.GetPseudoRoot(), params)
+        times.append(time.perf_counter() - start)
+    return times
+
+
+def reference(engine, stage, fbo, width, height, size, angle):
+    """Image accumulated with the camera at rest until converged."""
+    params = render_params()
+    set_camera(engine, width, height, size, angle)
+    fbo.bind()
+    engine.Render(stage.GetPseudoRoot(), params)
+    while not engine.IsConverged():
+        engine.Render(stage.GetPseudoRoot(), params)
+    image = read_image(fbo)
+    fbo.release()
+    return image
+
+
+def converge(engine, stage, fbo, width, height, size, angle, target,
+             noise, max_seconds):
+    """Averages interactive frames at angle until their mean squared error
+    against target is below noise.  Returns the render seconds spent and
+    the final error."""
+    params = render_params()
+    # the camera alternates between two eye positions that are too close to
+    # change the image, so every update renders an interactive frame
+    epsilon = 1e-5 * size
+    fbo.bind()
+    total = numpy.zeros_like(target)
+    seconds = 0.0
+    frames = 0
+    error = float("inf")
+    while seconds < max_seconds:
+        set_camera(engine, width, height, size, angle,
+                   epsilon if frames % 2 else 0.0)
+        start = time.perf_counter()
+        engine.Render(stage.GetPseudoRoot(), params)
+        seconds += time.perf_counter() - start
+        total += read_image(fbo)
+        frames += 1
+        error = float(numpy.mean((total / frames - target) ** 2))
+        if error < noise:
+            break
+    fbo.release()
+    return seconds, error
+
+
+def create_engine(clustering, threshold):
+    engine = UsdImagingGL.Engine()
+    if not engine.SetRendererPlugin("HdOSPRayPlugin"):
+        raise RuntimeError("HdOSPRay renderer plugin not found")
+    engine.SetRendererSetting("lightClustering", clustering)
+    engine.SetRendererSetting("lightClusterThreshold", threshold)
+    return engine
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split("\n")[0])
+    parser.add_argument("--lights", type=int, default=4096)
+    parser.add_argument("--updates", type=int, default=200)
+    parser.add_argument("--width", type=int, default=960)
+    parser.add_argument("--height", type=int, default=540)
+    parser.add_argument("--threshold", type=float, default=0.1,
+                        help="lightClusterThreshold render setting")
+    parser.add_argument("--views", type=int, default=4,
+                        help="orbit positions convergence is measured at")
+    parser.add_argument("--noise", type=float, default=1e-4,
+                        help="mean squared error against the reference "
+                             "interactive frames are averaged to")
+    parser.add_argument("--max-seconds", type=float, default=30.0,
+                        help="render time after which a view gives up")
+    parser.add_argument("--reference-samples", type=int, default=1024,
+                        help="samples per pixel of the reference images")
+    parser.add_argument("--seed", type=int, default=1)
+    parser.add_argument("--stage", default="lightClustering.usda",
+                        help="path the generated stage is written to")
+    args = parser.parse_args()
+
+    app = QGuiApplication([])
+    surface = QOffscreenSurface()
+    surface.setFormat(QSurfaceFormat.defaultFormat())
+    surface.create()
+    context = QOpenGLContext()
+    context.create()
+    context.makeCurrent(surface)
+
+    fbo_format = QOpenGLFramebufferObjectFormat()
+    fbo_format.setAttachment(QOpenGLFramebufferObject.Depth)
+    fbo = QOpenGLFramebufferObject(args.width, args.height, fbo_format)
+
+    size = 100.0
+    stage = create_stage(args.stage, args.lights, size, args.seed)
+    angles = [2.0 * math.pi * (i + 0.5) / args.views
+              for i in range(args.views)]
+    engine = create_engine(False, args.threshold)
+    engine.SetRendererSetting("samplesToConvergence", args.reference_samples)
+    references = [reference(engine, stage, fbo, args.width, args.height,
+                            size, angle) for angle in angles]
+    del engine
+
+    for clustering in (False, True):
+        engine = create_engine(clustering, args.threshold)
+        # the first updates build the scene and are not timed
+        orbit(engine, stage, args.width, args.height, size, 4)
+        times = sorted(orbit(engine, stage, args.width, args.height, size,
+                             args.updates))
+        print("lightClustering %-5s %d lights: mean %.2f ms, median %.2f ms,"
+              " max %.2f ms per update" % (
+                  clustering, args.lights,
+                  1000.0 * sum(times) / len(times),
+                  1000.0 * times[len(times) // 2], 1000.0 * times[-1]))
+        for angle, target in zip(angles, references):
+            seconds, error = converge(engine, stage, fbo, args.width,
+                                      args.height, size, angle, target,
+                                      args.noise, args.max_seconds)
+            if error < args.noise:
+                result = "%.2f s to error %.2e" % (seconds, args.noise)
+            else:
+                result = "error %.2e after %.2f s, not converged" % (
+                    error, seconds)
+            print("lightClustering %-5s view %5.1f deg: %s" % (
+                clustering, math.degrees(angle), result))
+        del engine
+    del fbo
+    context.doneCurrent()
+    del app
+
+
+if __name__ == "__main__":
+    main()
@@ -37,6 +37,25 @@ HdOSPRayBasisCurves::HdOSPRayBasisCurves(SdfPath const& id,
 {
 }
 
+void
+HdOSPRayBasisCurves::Finalize(HdRenderParam* renderParam)
+{
+    HdOSPRayRenderParam* ospRenderParam
+           = static_cast<HdOSPRayRenderParam*>(renderParam);
+    ospRenderParam->RemoveHdOSPRayBasisCurves(this);
+    ospRenderParam->RemoveMaterialBinding(this);
+
+    // release the OSPRay objects, the world still referencing them keeps
+    // them alive until it is replaced
+    ospRenderParam->RetireResource(std::move(_sharedArrays));
+    _ospInstances.clear();
+    _instanceClusters.clear();
+    _group = nullptr;
+    _geometricModels.clear();
+    _ospCurves = nullptr;
+    _populated = false;
+}
+
 HdDirtyBits
 HdOSPRayBasisCurves::GetInitialDirtyBitsMask() const
 {
@@ -79,8 +98,13 @@ HdOSPRayBasisCurves::Sync(HdSceneDelegate* delegate, HdRenderParam* renderParam,
     opp::Renderer renderer = ospRenderParam->GetOSPRayRenderer();
 
     SdfPath const& id = GetId();
+    const bool wasPopulated = _populated;
     bool updateGeometry = false;
     bool isTransformDirty = false;
+    // edits that only move the curves, as opposed to changing what they are
+    bool animated = false;
+    bool modelChanged = false;
+    bool groupDirty = false;
     if (*dirtyBits & HdChangeTracker::DirtyTopology) {
         _topology = delegate->GetBasisCurvesTopology(id);
         if (_topology.HasIndices()) {
@@ -88,7 +112,15 @@ HdOSPRayBasisCurves::Sync(HdSceneDelegate* delegate, HdRenderParam* renderParam,
         }
         updateGeometry = true;
     }
+    bool materialDirty = false;
     if (*dirtyBits & HdChangeTracker::DirtyMaterialId) {
+#if HD_API_VERSION < 37
+        _SetMaterialId(delegate->GetRenderIndex().GetChangeTracker(),
+                       delegate->GetMaterialId(id));
+#else
+        SetMaterialId(delegate->GetMaterialId(id));
+#endif
+        materialDirty = true;
     }
     if (*dirtyBits & HdChangeTracker::DirtyPrimvar) {
     }
@@ -109,11 +141,25 @@ HdOSPRayBasisCurves::Sync(HdSceneDelegate* delegate, HdRenderParam* renderParam,
         || HdChangeTracker::IsPrimvarDirty(*dirtyBits, id,
                                            HdOSPRayTokens->st)) {
         _UpdatePrimvarSources(delegate, *dirtyBits);
+        _buildOverrides = HdOSPRayBuildQuality::ReadOverrides(delegate, id);
         updateGeometry = true;
     }
 
     if (updateGeometry) {
         _UpdateOSPRayRepr(delegate, reprToken, dirtyBits, ospRenderParam);
+        groupDirty = true;
+        if ((*dirtyBits & HdChangeTracker::DirtyTopology)
+            || !HdChangeTracker::IsPrimvarDirty(*dirtyBits, id,
+                                                HdTokens->points))
+            modelChanged = true;
+        else
+            animated = true;
+    } else if (materialDirty && !_geometricModels.empty()) {
+        // rebinding keeps the geometry, the models are only re-pointed
+        _UpdateMaterial(delegate->GetRenderIndex(), ospRenderParam);
+        for (auto& gm : _geometricModels)
+            ospRenderParam->GetCommitQueue().Enqueue(gm);
+        ospRenderParam->UpdateMaterialVersion();
     }
 
 #if HD_API_VERSION < 36
@@ -124,56 +170,53 @@ HdOSPRayBasisCurves::Sync(HdSceneDelegate* delegate, HdRenderParam* renderParam,
                                           GetInstancerId());
 #endif
 
-    if ((HdChangeTracker::IsInstancerDirty(*dirtyBits, id) || isTransformDirty)
-        && !_geometricModels.empty()) {
-        _ospInstances.clear();
+    const bool instancesDirty
+           = HdChangeTracker::IsInstancerDirty(*dirtyBits, id)
+           || isTransformDirty;
+    // only points changes rebuild the BVH of the group, moving instances
+    // rebuilds the world
+    const bool deformed = animated;
+    animated |= instancesDirty;
+
+    // see HdOSPRayMesh::_PopulateOSPMesh
+    const int syncFrame = ospRenderParam->GetSyncFrame();
+    if (animated && wasPopulated) {
+        if (!IsDynamic(syncFrame))
+            modelChanged = true;
+        _lastAnimatedSync = syncFrame;
+        if (deformed)
+            _lastDeformedSync = syncFrame;
+    } else if (animated) {
+        modelChanged = true;
+    }
+
+    if (instancesDirty) {
         if (!GetInstancerId().IsEmpty()) {
             // Retrieve instance transforms from the instancer.
             HdRenderIndex& renderIndex = delegate->GetRenderIndex();
             HdInstancer* instancer = renderIndex.GetInstancer(GetInstancerId());
-            VtMatrix4dArray transforms
-                   = static_cast<HdOSPRayInstancer*>(instancer)
-                            ->ComputeInstanceTransforms(GetId());
-
-            size_t newSize = transforms.size();
-
-            opp::Group group;
-            group.setParam("geometry", opp::CopiedData(_geometricModels));
-            group.commit();
-
-            _ospInstances.reserve(newSize);
-            for (size_t i = 0; i < newSize; i++) {
-                opp::Instance instance(group);
-
-                GfMatrix4f matf = _xfm * GfMatrix4f(transforms[i]);
-                float* xfmf = matf.GetArray();
-                affine3f xfm(vec3f(xfmf[0], xfmf[1], xfmf[2]),
-                             vec3f(xfmf[4], xfmf[5], xfmf[6]),
-                             vec3f(xfmf[8], xfmf[9], xfmf[10]),
-                             vec3f(xfmf[12], xfmf[13], xfmf[14]));
-                instance.setParam("xfm", xfm);
-                instance.commit();
-                _ospInstances.push_back(instance);
-            }
+            _instanceTransforms = static_cast<HdOSPRayInstancer*>(instancer)
+                                         ->ComputeInstanceTransforms(GetId());
         } else {
-            opp::Group group;
-            group.setParam("geometry", opp::CopiedData(_geometricModels));
-            group.commit();
-            opp::Instance instance(group);
-            GfMatrix4f matf = _xfm;
-            float* xfmf = matf.GetArray();
-            affine3f xfm(vec3f(xfmf[0], xfmf[1], xfmf[2]),
-                         vec3f(xfmf[4], xfmf[5], xfmf[6]),
-                         vec3f(xfmf[8], xfmf[9], xfmf[10]),
-                         vec3f(xfmf[12], xfmf[13], xfmf[14]));
-            instance.setParam("xfm", xfm);
-            instance.commit();
-            _ospInstances.push_back(instance);
+            _instanceTransforms = VtMatrix4dArray(1, GfMatrix4d(1.0));
         }
+    }
 
-        ospRenderParam->UpdateModelVersion();
+    // see HdOSPRayMesh::_PopulateOSPMesh
+    groupDirty |= _UpdateBuildQuality(syncFrame);
+    if (groupDirty)
+        _CreateGroup(ospRenderParam->GetCommitQueue());
+    if (groupDirty || instancesDirty) {
+        _CreateInstances(ospRenderParam->GetCommitQueue());
+        if (!IsDynamic(syncFrame))
+            modelChanged = true;
     }
 
+    if (modelChanged)
+        ospRenderParam->UpdateModelVersion();
+    else if (animated || groupDirty)
+        ospRenderParam->UpdateDynamicModelVersion();
+
     *dirtyBits &= ~HdChangeTracker::AllSceneDirtyBits;
 }
 
@@ -277,22 +320,35 @@ HdOSPRayBasisCurves::_UpdateOSPRayRepr(HdSceneDelegate* sceneDelegate,
     }
 
     _ospCurves = opp::Geometry("curve");
-    _position_radii.clear();
-
+    _geometricModels.clear();
+    _bounds = GfRange3f();
+
+    // the arrays of the previous geometries stay alive as long as worlds
+    // may render them
+    renderParam->RetireResource(std::move(_sharedArrays));
+    _sharedArrays = std::make_shared<_SharedArrays>();
+    _sharedArrays->normals = _normals;
+    _sharedArrays->colors = _colors;
+    _sharedArrays->texcoords = _texcoords;
+    std::vector<vec4f>& positionRadii = _sharedArrays->positionRadii;
+    positionRadii.reserve(_points.size());
     for (size_t i = 0; i < _points.size(); i++) {
         const float width = hasWidths ? _widths[i] / 2.f : 1.0f;
-        _position_radii.emplace_back(
+        positionRadii.emplace_back(
                vec4f({ _points[i][0], _points[i][1], _points[i][2], width }));
+        _bounds.UnionWith(_points[i] - GfVec3f(width));
+        _bounds.UnionWith(_points[i] + GfVec3f(width));
     }
 
     opp::SharedData vertices = opp::SharedData(
-           _position_radii.data(), OSP_VEC4F, _position_radii.size());
+           positionRadii.data(), OSP_VEC4F, positionRadii.size());
     vertices.commit();
     _ospCurves.setParam("vertex.position_radius", vertices);
 
     opp::SharedData normals;
     if (hasNormals) {
-        normals = opp::SharedData(_normals.data(), OSP_VEC3F, _normals.size());
+        normals = opp::SharedData(_normals.cdata(), OSP_VEC3F,
+                                  _normals.size());
         normals.commit();
         _ospCurves.setParam("vertex.normal", normals);
     }
@@ -343,28 +399,14 @@ HdOSPRayBasisCurves::_UpdateOSPRayRepr(HdSceneDelegate* sceneDelegate,
             geometry.setParam("basis", OSP_CATMULL_ROM);
         else
             TF_RUNTIME_ERROR("hdospBS::sync: unsupported curve basis");
-        geometry.commit();
-        const HdRenderIndex& renderIndex = sceneDelegate->GetRenderIndex();
-        const HdOSPRayMaterial* material
-               = static_cast<const HdOSPRayMaterial*>(renderIndex.GetSprim(
-                      HdPrimTypeTokens->material, GetMaterialId()));
-        opp::Material ospMaterial;
-        if (material && material->GetOSPRayMaterial()) {
-            ospMaterial = material->GetOSPRayMaterial();
-        } else {
-            // no material, create a new one
-            ospMaterial = HdOSPRayMaterial::CreateDefaultMaterial(_singleColor);
-        }
-
-        // Create OSPRay model
-        auto gm = opp::GeometricModel(geometry);
+        renderParam->GetCommitQueue().Enqueue(geometry);
 
-        gm.setParam("material", ospMaterial);
-        gm.commit();
-        _geometricModels.push_back(gm);
+        // Create OSPRay model, committed once its material is set
+        _geometricModels.push_back(opp::GeometricModel(geometry));
     }
-
-    renderParam->UpdateModelVersion();
+    _UpdateMaterial(sceneDelegate->GetRenderIndex(), renderParam);
+    for (auto& gm : _geometricModels)
+        renderParam->GetCommitQueue().Enqueue(gm);
 
     if (!_populated) {
         renderParam->AddHdOSPRayBasisCurves(this);
@@ -372,12 +414,105 @@ HdOSPRayBasisCurves::_UpdateOSPRayRepr(HdSceneDelegate* sceneDelegate,
     }
 }
 
+void
+HdOSPRayBasisCurves::_UpdateMaterial(HdRenderIndex const& renderIndex,
+                                     HdOSPRayRenderParam* renderParam)
+{
+    const HdOSPRayMaterial* material = static_cast<const HdOSPRayMaterial*>(
+           renderIndex.GetSprim(HdPrimTypeTokens->material, GetMaterialId()));
+    opp::Material ospMaterial;
+    if (material && material->GetOSPRayMaterial()) {
+        ospMaterial = material->GetOSPRayMaterial();
+    } else {
+        // no material, share the default material of the color
+        ospMaterial = renderParam->GetMaterialCache().GetDefaultMaterial(
+               _singleColor);
+    }
+
+    HdOSPRayMaterialBinding binding;
+    binding.materialIds.push_back(GetMaterialId());
+    binding.materials.push_back(ospMaterial);
+    binding.models = _geometricModels;
+    binding.Apply();
+
+    // see HdOSPRayMesh::_UpdateMaterial
+    renderParam->SetMaterialBinding(this, binding);
+}
+
+bool
+HdOSPRayBasisCurves::IsDynamic(int syncFrame) const
+{
+    const int window = HdOSPRayConfig::GetInstance().dynamicSyncWindow;
+    return _lastAnimatedSync >= 0 && syncFrame - _lastAnimatedSync < window;
+}
+
+void
+HdOSPRayBasisCurves::UpdateBuildQuality(int syncFrame)
+{
+    if (!_UpdateBuildQuality(syncFrame))
+        return;
+    // see HdOSPRayMesh::UpdateBuildQuality
+    HdOSPRayCommitQueue commitQueue;
+    _CreateGroup(commitQueue);
+    _CreateInstances(commitQueue);
+    commitQueue.Commit();
+}
+
+bool
+HdOSPRayBasisCurves::_UpdateBuildQuality(int syncFrame)
+{
+    const int window = HdOSPRayConfig::GetInstance().dynamicSyncWindow;
+    const bool deforming = _lastDeformedSync >= 0
+           && syncFrame - _lastDeformedSync < window;
+    const HdOSPRayBuildQuality quality = HdOSPRayBuildQuality::Compute(
+           deforming, _points.size(), _buildOverrides);
+    if (quality == _buildQuality)
+        return false;
+    _buildQuality = quality;
+    return true;
+}
+
+void
+HdOSPRayBasisCurves::_CreateGroup(HdOSPRayCommitQueue& commitQueue)
+{
+    _group = opp::Group();
+    if (!_geometricModels.empty())
+        _group.setParam("geometry", opp::CopiedData(_geometricModels));
+    _buildQuality.Apply(_group);
+    commitQueue.Enqueue(_group);
+}
+
+void
+HdOSPRayBasisCurves::_CreateInstances(HdOSPRayCommitQueue& commitQueue)
+{
+    if (_geometricModels.empty()) {
+        _ospInstances.clear();
+        _instanceClusters.clear();
+        return;
+    }
+    HdOSPRayInstancer::CreateOSPInstances(_group, _xfm, _instanceTransforms,
+                                          _bounds, _ospInstances,
+                                          _instanceClusters);
+    commitQueue.Enqueue(_ospInstances);
+}
+
 void
 HdOSPRayBasisCurves::AddOSPInstances(
-       std::vector<opp::Instance>& instanceList) const
+       std::vector<opp::Instance>& instanceList,
+       HdOSPRayInstanceCuller const* culler) const
+{
+    if (IsVisible()) {
+        HdOSPRayInstancer::AddCulledOSPInstances(
+               _ospInstances, _instanceClusters, culler, instanceList);
+    }
+}
+
+void
+HdOSPRayBasisCurves::CullOSPInstances(HdOSPRayInstanceCuller const* culler,
+                                      std::vector<bool>& visible) const
 {
     if (IsVisible()) {
-        instanceList.insert(instanceList.end(), _ospInstances.begin(),
-                            _ospInstances.end());
+        HdOSPRayInstancer::CullInstanceClusters(_instanceClusters, culler,
+                                                visible);
     }
 }
\ No newline at end of file
@@ -4,6 +4,7 @@
 #pragma once
 
 #include <pxr/base/gf/matrix4f.h>
+#include <pxr/base/gf/range3f.h>
 #include <pxr/base/gf/vec2f.h>
 #include <pxr/base/vt/array.h>
 #include <pxr/imaging/hd/basisCurves.h>
@@ -14,12 +15,17 @@
 #include <ospray/ospray_cpp.h>
 #include <ospray/ospray_cpp/ext/rkcommon.h>
 
+#include "instancer.h"
+#include "renderDelegate.h"
+
+#include <memory>
 #include <mutex>
 
 namespace opp = ospray::cpp;
 
 PXR_NAMESPACE_USING_DIRECTIVE
 
+class HdOSPRayCommitQueue;
 class HdOSPRayRenderParam;
 
 /// \class HdOSPRayBasisCurves
@@ -37,11 +43,24 @@ public:
 
     virtual HdDirtyBits GetInitialDirtyBitsMask() const override;
 
-    virtual void Finalize(HdRenderParam* renderParam) override
-    {
-    }
+    virtual void Finalize(HdRenderParam* renderParam) override;
+
+    void AddOSPInstances(std::vector<opp::Instance>& instanceList,
+                         HdOSPRayInstanceCuller const* culler
+                         = nullptr) const;
+
+    /// Appends whether \p culler keeps each instance cluster to \p visible,
+    /// nothing if the curves are hidden
+    void CullOSPInstances(HdOSPRayInstanceCuller const* culler,
+                          std::vector<bool>& visible) const;
+
+    /// Whether the transform or points of the curves changed within the last
+    /// HdOSPRayConfig::dynamicSyncWindow syncs
+    bool IsDynamic(int syncFrame) const;
 
-    void AddOSPInstances(std::vector<opp::Instance>& instanceList) const;
+    /// Rebuilds the BVH of the curves in a new group if their build quality
+    /// changed
+    void UpdateBuildQuality(int syncFrame);
 
 protected:
     virtual void _InitRepr(TfToken const& reprToken,
@@ -57,20 +76,56 @@ protected:
                            HdDirtyBits* dirtyBitsState,
                            HdOSPRayRenderParam* renderParam);
 
+    // Updates _buildQuality, returns true if it changed
+    bool _UpdateBuildQuality(int syncFrame);
+
+    // Replaces _group by a new group of _geometricModels.  Worlds may still
+    // reference the previous group, so it is never modified.
+    void _CreateGroup(HdOSPRayCommitQueue& commitQueue);
+
+    // Replaces _ospInstances by new instances of _group
+    void _CreateInstances(HdOSPRayCommitQueue& commitQueue);
+
+    // Sets the bound material on all geometric models and registers the
+    // binding with renderParam.  The models still need to be committed.
+    void _UpdateMaterial(HdRenderIndex const& renderIndex,
+                         HdOSPRayRenderParam* renderParam);
+
 private:
     opp::Geometry _ospCurves;
     std::vector<opp::GeometricModel> _geometricModels;
+    // arrays shared with the geometries of _geometricModels, retired to the
+    // render param once they are replaced, as worlds may still render them
+    struct _SharedArrays {
+        std::vector<rkcommon::math::vec4f> positionRadii;
+        VtVec3fArray normals;
+        VtVec4fArray colors;
+        VtVec2fArray texcoords;
+    };
+    std::shared_ptr<_SharedArrays> _sharedArrays;
+    // group shared by all entries of _ospInstances
+    opp::Group _group;
+    HdOSPRayBuildQuality _buildQuality;
+    HdOSPRayBuildQuality::Overrides _buildOverrides;
     std::vector<opp::Instance> _ospInstances;
+    std::vector<HdOSPRayInstanceCluster> _instanceClusters;
+    // instancer transforms of _ospInstances, a single identity if the
+    // curves are not instanced
+    VtMatrix4dArray _instanceTransforms;
 
-    std::vector<rkcommon::math::vec4f> _position_radii;
     HdBasisCurvesTopology _topology;
     VtIntArray _indices;
     VtFloatArray _widths;
     VtVec3fArray _points;
+    GfRange3f _bounds; // object space bounds of the curve vertices
     VtVec3fArray _normals;
     GfMatrix4f _xfm;
     VtVec2fArray _texcoords;
     VtVec4fArray _colors;
     GfVec4f _singleColor { .5f, .5f, .5f, 1.f };
     bool _populated { false };
+    // sync frame of the last transform or points change, -1 if none
+    int _lastAnimatedSync { -1 };
+    // sync frame of the last points change, -1 if none
+    int _lastDeformedSync { -1 };
 };
@@ -3,9 +3,11 @@
 
 #include "config.h"
 
+#include <pxr/base/tf/diagnostic.h>
 #include <pxr/base/tf/envSetting.h>
 #include <pxr/base/tf/instantiateSingleton.h>
 
+#include <cstdlib>
 #include <iostream>
 
 // Instantiate the config singleton.
@@ -60,6 +62,87 @@ TF_DEFINE_ENV_SETTING(HDOSPRAY_FORCE_QUADRANGULATE, 0,
 TF_DEFINE_ENV_SETTING(HDOSPRAY_INTERACTIVE_TARGET_FPS, int(HDOSPRAY_DEFAULT_INTERACTIVE_TARGET_FPS),
         "set interactive scaling to match target fps when interacting.  0 Disables interactive scaling.");
 
+TF_DEFINE_ENV_SETTING(HDOSPRAY_BULK_INSTANCING_THRESHOLD, HDOSPRAY_DEFAULT_BULK_INSTANCING_THRESHOLD,
+        "Number of instances at which an instancer creates its OSPRay instances in parallel");
+
+TF_DEFINE_ENV_SETTING(HDOSPRAY_INSTANCE_CLUSTER_SIZE, HDOSPRAY_DEFAULT_INSTANCE_CLUSTER_SIZE,
+        "Number of instances grouped into one spatial cluster (0 disables clustering)");
+
+TF_DEFINE_ENV_SETTING(HDOSPRAY_INSTANCE_CULLING, HDOSPRAY_DEFAULT_INSTANCE_CULLING,
+        "Cull instances outside of the view frustum while the camera is moving");
+
+// TfEnvSetting has no float settings, these are parsed from strings and
+// empty strings keep the default
+TF_DEFINE_ENV_SETTING(HDOSPRAY_CULLING_FRUSTUM_MARGIN, "",
+        "Relative expansion of the view frustum used for instance culling");
+
+TF_DEFINE_ENV_SETTING(HDOSPRAY_CULLING_MAX_DISTANCE, "",
+        "Distance beyond which instance clusters are culled (0 disables)");
+
+TF_DEFINE_ENV_SETTING(HDOSPRAY_CULLING_MIN_SIZE, "",
+        "Ratio of cluster radius to camera distance below which instance clusters are culled (0 disables)");
+
+TF_DEFINE_ENV_SETTING(HDOSPRAY_DYNAMIC_SYNC_WINDOW, HDOSPRAY_DEFAULT_DYNAMIC_SYNC_WINDOW,
+        "Number of syncs a prim stays dynamic after its transform or points changed (0 treats all prims as static)");
+
+TF_DEFINE_ENV_SETTING(HDOSPRAY_COMPACT_MODE_THRESHOLD, HDOSPRAY_DEFAULT_COMPACT_MODE_THRESHOLD,
+        "Vertex count of a prim above which its BVH is built in compact mode (0 disables)");
+
+TF_DEFINE_ENV_SETTING(HDOSPRAY_WORLD_COMPACT_MODE_THRESHOLD, HDOSPRAY_DEFAULT_WORLD_COMPACT_MODE_THRESHOLD,
+        "Instance count of the world above which its BVH is built in compact mode (0 disables)");
+
+TF_DEFINE_ENV_SETTING(HDOSPRAY_ASYNC_WORLD_COMMIT, HDOSPRAY_DEFAULT_ASYNC_WORLD_COMMIT,
+        "Commit scene changes in the background while rendering the previous world");
+
+TF_DEFINE_ENV_SETTING(HDOSPRAY_TEXTURE_CACHE_SIZE, HDOSPRAY_DEFAULT_TEXTURE_CACHE_SIZE,
+        "Memory budget in MB for textures kept cached after their last use");
+
+TF_DEFINE_ENV_SETTING(HDOSPRAY_ASYNC_TEXTURE_LOADING, HDOSPRAY_DEFAULT_ASYNC_TEXTURE_LOADING,
+        "Decode material textures in the background, rendering placeholders meanwhile");
+
+TF_DEFINE_ENV_SETTING(HDOSPRAY_TEXTURE_MAX_RESOLUTION, HDOSPRAY_DEFAULT_TEXTURE_MAX_RESOLUTION,
+        "Largest texture width or height to load, 0 for full resolution");
+
+TF_DEFINE_ENV_SETTING(HDOSPRAY_INTERACTIVE_TEXTURE_MAX_RESOLUTION, HDOSPRAY_DEFAULT_INTERACTIVE_TEXTURE_MAX_RESOLUTION,
+        "Largest texture width or height to load while rendering interactively, 0 to disable");
+
+TF_DEFINE_ENV_SETTING(HDOSPRAY_TEXTURE_IMAGE_CACHE, HDOSPRAY_DEFAULT_TEXTURE_IMAGE_CACHE,
+        "Read texture files through a bounded OIIO ImageCache");
+
+TF_DEFINE_ENV_SETTING(HDOSPRAY_IMAGE_CACHE_SIZE, HDOSPRAY_DEFAULT_IMAGE_CACHE_SIZE,
+        "Memory in MB of the OIIO ImageCache");
+
+TF_DEFINE_ENV_SETTING(HDOSPRAY_TEXTURE_DISK_CACHE, "",
+        "Directory of the persistent cache of decoded textures, disabled if empty");
+
+TF_DEFINE_ENV_SETTING(HDOSPRAY_SIMPLIFY_MATERIALS, HDOSPRAY_DEFAULT_SIMPLIFY_MATERIALS,
+        "Render materials with the cheapest OSPRay material model reproducing them");
+
+TF_DEFINE_ENV_SETTING(HDOSPRAY_PREVIEW_MATERIALS, HDOSPRAY_DEFAULT_PREVIEW_MATERIALS,
+        "Simplify materials with preview instead of final fidelity");
+
+TF_DEFINE_ENV_SETTING(HDOSPRAY_INTERACTIVE_DOME_LIGHT_MAX_RESOLUTION, HDOSPRAY_DEFAULT_INTERACTIVE_DOME_LIGHT_MAX_RESOLUTION,
+        "Largest dome light texture width or height to load while rendering interactively, 0 to disable");
+
+TF_DEFINE_ENV_SETTING(HDOSPRAY_LIGHT_CLUSTERING, HDOSPRAY_DEFAULT_LIGHT_CLUSTERING,
+        "Replace clusters of distant or dim lights by representative lights while rendering interactively");
+
+// parses a float setting, returns defaultValue if it is empty or invalid
+static float
+_GetFloatSetting(std::string const& value, float defaultValue)
+{
+    if (value.empty())
+        return defaultValue;
+    char* end = nullptr;
+    const float result = std::strtof(value.c_str(), &end);
+    if (end == value.c_str() || *end != '\0') {
+        TF_WARN("Invalid number '%s', using %g.", value.c_str(),
+                defaultValue);
+        return defaultValue;
+    }
+    return result;
+}
+
 HdOSPRayConfig::HdOSPRayConfig()
 {
     // Read in values from the environment, clamping them to valid ranges.
@@ -80,6 +163,42 @@ HdOSPRayConfig::HdOSPRayConfig()
     forceQuadrangulate = TfGetEnvSetting(HDOSPRAY_FORCE_QUADRANGULATE);
     maxDepth = TfGetEnvSetting(HDOSPRAY_MAX_PATH_DEPTH);
     useSimpleMaterial = TfGetEnvSetting(HDOSPRAY_USE_SIMPLE_MATERIAL);
+    bulkInstancingThreshold = std::max(1,
+            TfGetEnvSetting(HDOSPRAY_BULK_INSTANCING_THRESHOLD));
+    instanceClusterSize = std::max(0,
+            TfGetEnvSetting(HDOSPRAY_INSTANCE_CLUSTER_SIZE));
+    instanceCulling = TfGetEnvSetting(HDOSPRAY_INSTANCE_CULLING);
+    cullingFrustumMargin = std::max(0.f,
+            _GetFloatSetting(TfGetEnvSetting(HDOSPRAY_CULLING_FRUSTUM_MARGIN),
+                             HDOSPRAY_DEFAULT_CULLING_FRUSTUM_MARGIN));
+    cullingMaxDistance = std::max(0.f,
+            _GetFloatSetting(TfGetEnvSetting(HDOSPRAY_CULLING_MAX_DISTANCE),
+                             HDOSPRAY_DEFAULT_CULLING_MAX_DISTANCE));
+    cullingMinSize = std::max(0.f,
+            _GetFloatSetting(TfGetEnvSetting(HDOSPRAY_CULLING_MIN_SIZE),
+                             HDOSPRAY_DEFAULT_CULLING_MIN_SIZE));
+    dynamicSyncWindow = std::max(0,
+            TfGetEnvSetting(HDOSPRAY_DYNAMIC_SYNC_WINDOW));
+    compactModeThreshold = std::max(0,
+            TfGetEnvSetting(HDOSPRAY_COMPACT_MODE_THRESHOLD));
+    worldCompactModeThreshold = std::max(0,
+            TfGetEnvSetting(HDOSPRAY_WORLD_COMPACT_MODE_THRESHOLD));
+    asyncWorldCommit = TfGetEnvSetting(HDOSPRAY_ASYNC_WORLD_COMMIT);
+    textureCacheSize = std::max(0,
+            TfGetEnvSetting(HDOSPRAY_TEXTURE_CACHE_SIZE));
+    asyncTextureLoading = TfGetEnvSetting(HDOSPRAY_ASYNC_TEXTURE_LOADING);
+    textureMaxResolution = std::max(0,
+            TfGetEnvSetting(HDOSPRAY_TEXTURE_MAX_RESOLUTION));
+    interactiveTextureMaxResolution = std::max(0,
+            TfGetEnvSetting(HDOSPRAY_INTERACTIVE_TEXTURE_MAX_RESOLUTION));
+    textureImageCache = TfGetEnvSetting(HDOSPRAY_TEXTURE_IMAGE_CACHE);
+    imageCacheSize = std::max(0, TfGetEnvSetting(HDOSPRAY_IMAGE_CACHE_SIZE));
+    textureDiskCache = TfGetEnvSetting(HDOSPRAY_TEXTURE_DISK_CACHE);
+    simplifyMaterials = TfGetEnvSetting(HDOSPRAY_SIMPLIFY_MATERIALS);
+    previewMaterials = TfGetEnvSetting(HDOSPRAY_PREVIEW_MATERIALS);
+    interactiveDomeLightMaxResolution = std::max(0,
+            TfGetEnvSetting(HDOSPRAY_INTERACTIVE_DOME_LIGHT_MAX_RESOLUTION));
+    lightClustering = TfGetEnvSetting(HDOSPRAY_LIGHT_CLUSTERING);
 
     if (TfGetEnvSetting(HDOSPRAY_PRINT_CONFIGURATION) > 0) {
         std::cout
@@ -33,6 +33,27 @@ namespace opp = ospray::cpp;
 #define HDOSPRAY_DEFAULT_TMP_MIDIN 0.18f
 #define HDOSPRAY_DEFAULT_TMP_MIDOUT 0.18f
 #define HDOSPRAY_DEFAULT_TMP_ACESCOLOR false
+#define HDOSPRAY_DEFAULT_BULK_INSTANCING_THRESHOLD 4096
+#define HDOSPRAY_DEFAULT_INSTANCE_CLUSTER_SIZE 0
+#define HDOSPRAY_DEFAULT_INSTANCE_CULLING false
+#define HDOSPRAY_DEFAULT_CULLING_FRUSTUM_MARGIN 0.25f
+#define HDOSPRAY_DEFAULT_CULLING_MAX_DISTANCE 0.0f
+#define HDOSPRAY_DEFAULT_CULLING_MIN_SIZE 0.001f
+#define HDOSPRAY_DEFAULT_DYNAMIC_SYNC_WINDOW 16
+#define HDOSPRAY_DEFAULT_COMPACT_MODE_THRESHOLD 8388608
+#define HDOSPRAY_DEFAULT_WORLD_COMPACT_MODE_THRESHOLD 1048576
+#define HDOSPRAY_DEFAULT_ASYNC_WORLD_COMMIT true
+#define HDOSPRAY_DEFAULT_TEXTURE_CACHE_SIZE 2048
+#define HDOSPRAY_DEFAULT_ASYNC_TEXTURE_LOADING true
+#define HDOSPRAY_DEFAULT_TEXTURE_MAX_RESOLUTION 0
+#define HDOSPRAY_DEFAULT_INTERACTIVE_TEXTURE_MAX_RESOLUTION 0
+#define HDOSPRAY_DEFAULT_TEXTURE_IMAGE_CACHE false
+#define HDOSPRAY_DEFAULT_IMAGE_CACHE_SIZE 1024
+#define HDOSPRAY_DEFAULT_SIMPLIFY_MATERIALS true
+#define HDOSPRAY_DEFAULT_PREVIEW_MATERIALS false
+#define HDOSPRAY_DEFAULT_INTERACTIVE_DOME_LIGHT_MAX_RESOLUTION 0
+#define HDOSPRAY_DEFAULT_LIGHT_CLUSTERING false
+#define HDOSPRAY_DEFAULT_LIGHT_CLUSTER_THRESHOLD 0.1f
 
 PXR_NAMESPACE_USING_DIRECTIVE
 
@@ -175,6 +196,160 @@ public:
     float tmp_midOut { HDOSPRAY_DEFAULT_TMP_MIDOUT };
     bool tmp_acesColor { HDOSPRAY_DEFAULT_TMP_ACESCOLOR };
 
+    ///  Instance count at which instancers create their OSPRay instances
+    ///  in parallel.
+    ///
+    /// Override with *HDOSPRAY_BULK_INSTANCING_THRESHOLD*.
+    unsigned int bulkInstancingThreshold {
+        HDOSPRAY_DEFAULT_BULK_INSTANCING_THRESHOLD
+    };
+
+    ///  Number of instances per spatial cluster of an instancer.
+    ///  A value of 0 disables clustering.
+    ///
+    /// Override with *HDOSPRAY_INSTANCE_CLUSTER_SIZE*.
+    unsigned int instanceClusterSize { HDOSPRAY_DEFAULT_INSTANCE_CLUSTER_SIZE };
+
+    ///  Cull instance clusters while the camera is moving
+    ///
+    /// Override with *HDOSPRAY_INSTANCE_CULLING*.
+    bool instanceCulling { HDOSPRAY_DEFAULT_INSTANCE_CULLING };
+
+    ///  Relative expansion of the view frustum used for instance culling
+    ///
+    /// Override with *HDOSPRAY_CULLING_FRUSTUM_MARGIN*.
+    float cullingFrustumMargin { HDOSPRAY_DEFAULT_CULLING_FRUSTUM_MARGIN };
+
+    ///  Distance beyond which instance clusters are culled.  0 disables
+    ///  distance culling.
+    ///
+    /// Override with *HDOSPRAY_CULLING_MAX_DISTANCE*.
+    float cullingMaxDistance { HDOSPRAY_DEFAULT_CULLING_MAX_DISTANCE };
+
+    ///  Minimum ratio of cluster radius to camera distance below which
+    ///  instance clusters are culled.  0 disables size culling.
+    ///
+    /// Override with *HDOSPRAY_CULLING_MIN_SIZE*.
+    float cullingMinSize { HDOSPRAY_DEFAULT_CULLING_MIN_SIZE };
+
+    ///  Number of syncs after its last transform or points change that a
+    ///  prim is treated as dynamic.  Dynamic prims are gathered into the
+    ///  world every frame, static prims are cached.  0 treats all prims as
+    ///  static.
+    ///
+    /// Override with *HDOSPRAY_DYNAMIC_SYNC_WINDOW*.
+    unsigned int dynamicSyncWindow { HDOSPRAY_DEFAULT_DYNAMIC_SYNC_WINDOW };
+
+    ///  Vertex count of a prim above which its BVH is built in compact mode
+    ///  to save memory.  0 disables compact mode.
+    ///
+    /// Override with *HDOSPRAY_COMPACT_MODE_THRESHOLD*.
+    unsigned int compactModeThreshold {
+        HDOSPRAY_DEFAULT_COMPACT_MODE_THRESHOLD
+    };
+
+    ///  Instance count of the world above which its BVH is built in compact
+    ///  mode to save memory.  0 disables compact mode.
+    ///
+    /// Override with *HDOSPRAY_WORLD_COMPACT_MODE_THRESHOLD*.
+    unsigned int worldCompactModeThreshold {
+        HDOSPRAY_DEFAULT_WORLD_COMPACT_MODE_THRESHOLD
+    };
+
+    ///  Commit scene changes in the background and keep rendering the
+    ///  previous world until the new BVH is built
+    ///
+    /// Override with *HDOSPRAY_ASYNC_WORLD_COMMIT*.
+    bool asyncWorldCommit { HDOSPRAY_DEFAULT_ASYNC_WORLD_COMMIT };
+
+    ///  Texture memory in MB up to which textures no longer used by any
+    ///  material or light stay cached.  Beyond it they are evicted least
+    ///  recently used first.
+    ///
+    /// Override with *HDOSPRAY_TEXTURE_CACHE_SIZE*.
+    unsigned int textureCacheSize { HDOSPRAY_DEFAULT_TEXTURE_CACHE_SIZE };
+
+    ///  Decode material textures on background threads.  Materials render
+    ///  with a constant placeholder until their textures are loaded.
+    ///
+    /// Override with *HDOSPRAY_ASYNC_TEXTURE_LOADING*.
+    bool asyncTextureLoading { HDOSPRAY_DEFAULT_ASYNC_TEXTURE_LOADING };
+
+    ///  Largest width or height material textures are loaded with, using
+    ///  the MIP levels of the file if present.  0 loads full resolution.
+    ///  Texture nodes can override it with an "ospray:maxResolution" input.
+    ///
+    /// Override with *HDOSPRAY_TEXTURE_MAX_RESOLUTION*.
+    unsigned int textureMaxResolution {
+        HDOSPRAY_DEFAULT_TEXTURE_MAX_RESOLUTION
+    };
+
+    ///  Additional texture resolution limit for materials synced while
+    ///  interactive rendering is enabled.  0 disables it.
+    ///
+    /// Override with *HDOSPRAY_INTERACTIVE_TEXTURE_MAX_RESOLUTION*.
+    unsigned int interactiveTextureMaxResolution {
+        HDOSPRAY_DEFAULT_INTERACTIVE_TEXTURE_MAX_RESOLUTION
+    };
+
+    ///  Read texture files through a private OIIO ImageCache instead of
+    ///  decoding whole files, so only the tiles of the loaded MIP level are
+    ///  read and decode memory stays bounded.
+    ///
+    /// Override with *HDOSPRAY_TEXTURE_IMAGE_CACHE*.
+    bool textureImageCache { HDOSPRAY_DEFAULT_TEXTURE_IMAGE_CACHE };
+
+    ///  Memory in MB of the OIIO ImageCache used with textureImageCache.
+    ///  Each texture read through it loads the largest MIP level whose
+    ///  texels fit in it, the total of all textures is not bounded.  0
+    ///  leaves the cache size and resolution unbounded.
+    ///
+    /// Override with *HDOSPRAY_IMAGE_CACHE_SIZE*.
+    unsigned int imageCacheSize { HDOSPRAY_DEFAULT_IMAGE_CACHE_SIZE };
+
+    ///  Directory of the persistent cache of decoded textures.  Entries are
+    ///  memory mapped on later loads instead of decoding the file again.
+    ///  Disabled if empty.
+    ///
+    /// Override with *HDOSPRAY_TEXTURE_DISK_CACHE*.
+    std::string textureDiskCache;
+
+    ///  Let the path tracer render UsdPreviewSurface materials with the
+    ///  cheapest OSPRay material model reproducing them, e.g. obj for rough
+    ///  plastics and alloy for metals, instead of always using principled.
+    ///
+    /// Override with *HDOSPRAY_SIMPLIFY_MATERIALS*.
+    bool simplifyMaterials { HDOSPRAY_DEFAULT_SIMPLIFY_MATERIALS };
+
+    ///  Simplify materials with preview fidelity, which drops small coat,
+    ///  transmission and metallic weights and approximates all remaining
+    ///  dielectrics without roughness texture with the obj material.
+    ///
+    /// Override with *HDOSPRAY_PREVIEW_MATERIALS*.
+    bool previewMaterials { HDOSPRAY_DEFAULT_PREVIEW_MATERIALS };
+
+    ///  Largest width or height of dome light textures of lights synced
+    ///  while interactive rendering is enabled.  Smaller maps decode and
+    ///  build their importance sampling distribution faster.  0 disables
+    ///  the limit.
+    ///
+    /// Override with *HDOSPRAY_INTERACTIVE_DOME_LIGHT_MAX_RESOLUTION*.
+    unsigned int interactiveDomeLightMaxResolution {
+        HDOSPRAY_DEFAULT_INTERACTIVE_DOME_LIGHT_MAX_RESOLUTION
+    };
+
+    ///  Replace clusters of distant or dim local lights by representative
+    ///  lights while rendering interactively
+    ///
+    /// Override with *HDOSPRAY_LIGHT_CLUSTERING*.
+    bool lightClustering { HDOSPRAY_DEFAULT_LIGHT_CLUSTERING };
+
+    ///  Ratio of cluster radius to camera distance below which light
+    ///  clusters are replaced by their representative.  Clusters whose
+    ///  estimated irradiance at the camera is below its square, relative to
+    ///  all lights, are replaced as well.
+    float lightClusterThreshold { HDOSPRAY_DEFAULT_LIGHT_CLUSTER_THRESHOLD };
+
     // meshes populate global instances.  These are then committed by the
     // renderPass into a scene.
     std::vector<opp::Geometry> ospInstances;
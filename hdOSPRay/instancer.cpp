@@ -4,16 +4,28 @@
 #include "instancer.h"
 
 #include <pxr/imaging/hd/sceneDelegate.h>
+#include "config.h"
 #include "sampler.h"
 
+#include <pxr/base/gf/bbox3d.h>
 #include <pxr/base/gf/matrix4d.h>
 #include <pxr/base/gf/quaternion.h>
 #include <pxr/base/gf/rotation.h>
 #include <pxr/base/gf/vec3f.h>
+#include <pxr/base/gf/vec4d.h>
 #include <pxr/base/gf/vec4f.h>
 #include <pxr/base/tf/staticTokens.h>
 
+#include <rkcommon/math/AffineSpace.h>
+
+#include <tbb/blocked_range.h>
+#include <tbb/parallel_for.h>
+#include <tbb/parallel_sort.h>
+
 #include <iostream>
+#include <numeric>
+
+using namespace rkcommon::math;
 
 // clang-format off
 TF_DEFINE_PRIVATE_TOKENS(
@@ -210,4 +222,208 @@ HdOSPRayInstancer::ComputeInstanceTransforms(SdfPath const& prototypeId)
         }
     }
     return final;
-}
\ No newline at end of file
+}
+
+static affine3f
+_ToAffine3f(GfMatrix4f const& matf)
+{
+    const float* xfmf = matf.GetArray();
+    return affine3f(vec3f(xfmf[0], xfmf[1], xfmf[2]),
+                    vec3f(xfmf[4], xfmf[5], xfmf[6]),
+                    vec3f(xfmf[8], xfmf[9], xfmf[10]),
+                    vec3f(xfmf[12], xfmf[13], xfmf[14]));
+}
+
+// spreads the lower 10 bits of v so that two zero bits follow each bit
+static uint32_t
+_ExpandBits(uint32_t v)
+{
+    v = (v * 0x00010001u) & 0xFF0000FFu;
+    v = (v * 0x00000101u) & 0x0F00F00Fu;
+    v = (v * 0x00000011u) & 0xC30C30C3u;
+    v = (v * 0x00000005u) & 0x49249249u;
+    return v;
+}
+
+// calls func(begin, end) over [0, size), in parallel if requested
+template <class Func>
+static void
+_ForEachRange(size_t size, bool parallel, Func const& func)
+{
+    if (parallel) {
+        tbb::parallel_for(tbb::blocked_range<size_t>(0, size),
+                          [&](tbb::blocked_range<size_t> r) {
+                              func(r.begin(), r.end());
+                          });
+    } else {
+        func(0, size);
+    }
+}
+
+void
+HdOSPRayInstancer::CreateOSPInstances(
+       opp::Group group, GfMatrix4f const& primTransform,
+       VtMatrix4dArray const& transforms, GfRange3f const& prototypeBounds,
+       std::vector<opp::Instance>& instances,
+       std::vector<HdOSPRayInstanceCluster>& clusters)
+{
+    HD_TRACE_FUNCTION();
+    HF_MALLOC_TAG_FUNCTION();
+
+    const HdOSPRayConfig& config = HdOSPRayConfig::GetInstance();
+    const size_t numInstances = transforms.size();
+    const size_t clusterSize = config.instanceClusterSize;
+    const bool parallel = numInstances >= config.bulkInstancingThreshold;
+
+    instances.clear();
+    clusters.clear();
+    instances.resize(numInstances);
+
+    std::vector<GfMatrix4f> xfms(numInstances);
+    _ForEachRange(numInstances, parallel, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++)
+            xfms[i] = primTransform * GfMatrix4f(transforms[i]);
+    });
+
+    // order instances along a Morton curve over their centers, so that
+    // consecutive instances form spatially compact clusters
+    std::vector<size_t> order(numInstances);
+    std::iota(order.begin(), order.end(), 0);
+    if (clusterSize > 0 && numInstances > clusterSize) {
+        const GfVec3f center = prototypeBounds.IsEmpty()
+               ? GfVec3f(0.f)
+               : prototypeBounds.GetMidpoint();
+        std::vector<GfVec3f> centers(numInstances);
+        GfRange3f centerBounds;
+        for (size_t i = 0; i < numInstances; i++) {
+            centers[i] = xfms[i].Transform(center);
+            centerBounds.UnionWith(centers[i]);
+        }
+        const GfVec3f extent = centerBounds.GetSize();
+        std::vector<uint32_t> codes(numInstances);
+        _ForEachRange(numInstances, parallel, [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i++) {
+                const GfVec3f p = centers[i] - centerBounds.GetMin();
+                uint32_t cell[3];
+                for (int a = 0; a < 3; a++) {
+                    const float t = extent[a] > 0.f ? p[a] / extent[a] : 0.f;
+                    cell[a] = std::min(1023u, uint32_t(t * 1024.f));
+                }
+                codes[i] = (_ExpandBits(cell[0]) << 2)
+                       | (_ExpandBits(cell[1]) << 1) | _ExpandBits(cell[2]);
+            }
+        });
+        tbb::parallel_sort(order.begin(), order.end(),
+                           [&codes](size_t a, size_t b) {
+                               return codes[a] < codes[b];
+                           });
+    }
+
+    // OSPRay objects are independent, so instances can be created
+    // concurrently.  They are committed after their group in
+    // CommitResources.
+    _ForEachRange(numInstances, parallel, [&](size_t begin, size_t end) {
+        for (size_t slot = begin; slot < end; slot++) {
+            const size_t i = order[slot];
+            opp::Instance instance(group);
+            instance.setParam("xfm", _ToAffine3f(xfms[i]));
+            instance.setParam("id", (unsigned int)i);
+            instances[slot] = instance;
+        }
+    });
+
+    if (numInstances == 0 || prototypeBounds.IsEmpty())
+        return;
+
+    const size_t instancesPerCluster
+           = clusterSize > 0 ? clusterSize : numInstances;
+    const size_t numClusters
+           = (numInstances + instancesPerCluster - 1) / instancesPerCluster;
+    clusters.resize(numClusters);
+    _ForEachRange(numClusters, parallel, [&](size_t begin, size_t end) {
+        for (size_t c = begin; c < end; c++) {
+            HdOSPRayInstanceCluster& cluster = clusters[c];
+            cluster.begin = c * instancesPerCluster;
+            cluster.end = std::min(numInstances,
+                                   cluster.begin + instancesPerCluster);
+            for (size_t slot = cluster.begin; slot < cluster.end; slot++) {
+                GfBBox3d box(GfRange3d(prototypeBounds),
+                             GfMatrix4d(xfms[order[slot]]));
+                cluster.bounds.UnionWith(GfRange3f(box.ComputeAlignedRange()));
+            }
+        }
+    });
+}
+
+void
+HdOSPRayInstancer::AddCulledOSPInstances(
+       std::vector<opp::Instance> const& instances,
+       std::vector<HdOSPRayInstanceCluster> const& clusters,
+       HdOSPRayInstanceCuller const* culler,
+       std::vector<opp::Instance>& instanceList)
+{
+    if (!culler || clusters.empty()) {
+        instanceList.insert(instanceList.end(), instances.begin(),
+                            instances.end());
+        return;
+    }
+
+    for (const auto& cluster : clusters) {
+        if (culler->IsVisible(cluster.bounds)) {
+            instanceList.insert(instanceList.end(),
+                                instances.begin() + cluster.begin,
+                                instances.begin() + cluster.end);
+        }
+    }
+}
+
+void
+HdOSPRayInstancer::CullInstanceClusters(
+       std::vector<HdOSPRayInstanceCluster> const& clusters,
+       HdOSPRayInstanceCuller const* culler, std::vector<bool>& visible)
+{
+    if (clusters.empty()) {
+        visible.push_back(true);
+        return;
+    }
+
+    for (const auto& cluster : clusters)
+        visible.push_back(!culler || culler->IsVisible(cluster.bounds));
+}
+
+bool
+HdOSPRayInstanceCuller::IsVisible(GfRange3f const& bounds) const
+{
+    if (bounds.IsEmpty())
+        return true;
+
+    const GfVec3d center(bounds.GetMidpoint());
+    const double radius = 0.5 * GfVec3d(bounds.GetSize()).GetLength();
+    const double distance = (center - eye).GetLength();
+    if (distance <= radius)
+        return true; // camera inside of bounds
+
+    if (maxDistance > 0.f && distance - radius > maxDistance)
+        return false;
+    if (minSize > 0.f && radius / distance < minSize)
+        return false;
+
+    // cull if all corners lie outside of the same expanded clip plane
+    const double k = 1.0 + frustumMargin;
+    int outside[5] = { 0, 0, 0, 0, 0 };
+    for (int i = 0; i < 8; i++) {
+        const GfVec3d corner(bounds.GetCorner(i));
+        const GfVec4d p = GfVec4d(corner[0], corner[1], corner[2], 1.0)
+               * worldToClip;
+        outside[0] += (p[0] < -k * p[3]);
+        outside[1] += (p[0] > k * p[3]);
+        outside[2] += (p[1] < -k * p[3]);
+        outside[3] += (p[1] > k * p[3]);
+        outside[4] += (p[2] < -p[3]); // behind the near plane
+    }
+    for (int plane = 0; plane < 5; plane++) {
+        if (outside[plane] == 8)
+            return false;
+    }
+    return true;
+}
@@ -8,13 +8,55 @@
 #include <pxr/imaging/hd/instancer.h>
 #include <pxr/imaging/hd/vtBufferSource.h>
 
+#include <pxr/base/gf/matrix4d.h>
+#include <pxr/base/gf/matrix4f.h>
+#include <pxr/base/gf/range3f.h>
 #include <pxr/base/tf/hashmap.h>
 #include <pxr/base/tf/token.h>
 
+#include <ospray/ospray_cpp.h>
+#include <ospray/ospray_cpp/ext/rkcommon.h>
+
 #include <mutex>
+#include <vector>
+
+namespace opp = ospray::cpp;
 
 PXR_NAMESPACE_USING_DIRECTIVE
 
+/// \struct HdOSPRayInstanceCluster
+///
+/// A contiguous range of spatially close instances of one prototype, with
+/// the world space bounds of all instances in the range.
+///
+struct HdOSPRayInstanceCluster {
+    size_t begin { 0 };
+    size_t end { 0 };
+    GfRange3f bounds;
+};
+
+/// \struct HdOSPRayInstanceCuller
+///
+/// Camera state used to drop instance clusters outside of an expanded view
+/// frustum, beyond a maximum distance, or below a minimum angular size.
+///
+struct HdOSPRayInstanceCuller {
+    /// world to clip space transform of the camera
+    GfMatrix4d worldToClip { 1.0 };
+    /// camera position
+    GfVec3d eye { 0.0 };
+    /// relative expansion of the frustum in clip space
+    float frustumMargin { 0.f };
+    /// clusters further away are culled, 0 disables distance culling
+    float maxDistance { 0.f };
+    /// clusters with a smaller bounds radius to distance ratio are culled, 0
+    /// disables size culling
+    float minSize { 0.f };
+
+    /// returns true if a cluster with the given world space bounds is kept
+    bool IsVisible(GfRange3f const& bounds) const;
+};
+
 class HdOSPRayInstancer : public HdInstancer {
 public:
 #if HD_API_VERSION < 36
@@ -37,6 +79,42 @@ public:
 
     VtMatrix4dArray ComputeInstanceTransforms(SdfPath const& prototypeId);
 
+    /// Creates one uncommitted OSPRay instance of \p group per instance
+    /// transform, see HdOSPRayCommitQueue.  Instancers above the bulk
+    /// instancing threshold create their instances in parallel.  If instance
+    /// clustering is enabled, instances are ordered spatially and
+    /// \p clusters receives the ranges and bounds of each cluster,
+    /// otherwise a single cluster spans all instances.
+    ///   \param group the prototype group
+    ///   \param primTransform object to instancer space transform of the prim
+    ///   \param transforms per instance transforms
+    ///   \param prototypeBounds object space bounds of the prototype
+    ///   \param instances output instances
+    ///   \param clusters output instance clusters
+    static void
+    CreateOSPInstances(opp::Group group, GfMatrix4f const& primTransform,
+                       VtMatrix4dArray const& transforms,
+                       GfRange3f const& prototypeBounds,
+                       std::vector<opp::Instance>& instances,
+                       std::vector<HdOSPRayInstanceCluster>& clusters);
+
+    /// Appends the instances of all clusters kept by \p culler to
+    /// \p instanceList.  All instances are added if \p culler is null or no
+    /// clusters are known.
+    static void
+    AddCulledOSPInstances(std::vector<opp::Instance> const& instances,
+                          std::vector<HdOSPRayInstanceCluster> const& clusters,
+                          HdOSPRayInstanceCuller const* culler,
+                          std::vector<opp::Instance>& instanceList);
+
+    /// Appends whether each cluster is kept by \p culler to \p visible.
+    /// Appends a single true entry if no clusters are known, and true for
+    /// all clusters if \p culler is null.
+    static void
+    CullInstanceClusters(std::vector<HdOSPRayInstanceCluster> const& clusters,
+                         HdOSPRayInstanceCuller const* culler,
+                         std::vector<bool>& visible);
+
 private:
 #if HD_API_VERSION < 36
     void _SyncPrimvars();
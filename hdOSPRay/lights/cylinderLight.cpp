@@ -59,7 +59,8 @@ HdOSPRayCylinderLight::_PrepareOSPLight()
     position0 = _transform.Transform(position0);
     position1 = _transform.Transform(position1);
 
-    _ospLight = opp::Light("cylinder");
+    if (!_ospLight)
+        _ospLight = opp::Light("cylinder");
     // placement
     _ospLight.setParam("position0",
                        vec3f(position0[0], position0[1], position0[2]));
@@ -76,4 +77,9 @@ HdOSPRayCylinderLight::_PrepareOSPLight()
     _ospLight.setParam("intensity", intensity);
     _ospLight.setParam("visible", _cameraVisibility);
     _ospLight.commit();
+
+    const float length = (position1 - position0).GetLength();
+    _SetLightProxy(0.5f * (position0 + position1), 0.5f * length + _radius,
+                   2.f * float(M_PI) * _radius * length, intensityQuantity,
+                   intensity);
 }
\ No newline at end of file
@@ -76,7 +76,8 @@ HdOSPRayDiskLight::_PrepareOSPLight()
 
     // in OSPRay a disk light is represented by a spot light
     // having a radius > 0.0
-    _ospLight = opp::Light("spot");
+    if (!_ospLight)
+        _ospLight = opp::Light("spot");
     // placement
     _ospLight.setParam("position",
                        vec3f(position[0], position[1], position[2]));
@@ -96,4 +97,7 @@ HdOSPRayDiskLight::_PrepareOSPLight()
     _ospLight.setParam("intensity", intensity);
     _ospLight.setParam("visible", _cameraVisibility);
     _ospLight.commit();
+
+    _SetLightProxy(position, radius, float(M_PI) * radius * radius,
+                   intensityQuantity, intensity);
 }
\ No newline at end of file
@@ -3,6 +3,7 @@
 
 #include "domeLight.h"
 #include "../config.h"
+#include "../renderDelegate.h"
 #include "../texture.h"
 
 #include <pxr/imaging/hd/perfLog.h>
@@ -43,6 +44,17 @@ HdOSPRayDomeLight::_LightSpecificSync(HdSceneDelegate* sceneDelegate,
             TF_DEBUG_MSG(OSP, "osp:: dome light %s\n", _textureFile.c_str());
         }
     }
+
+    // lights synced while rendering interactively load reduced resolutions
+    const HdOSPRayConfig& config = HdOSPRayConfig::GetInstance();
+    HdRenderDelegate* renderDelegate
+           = sceneDelegate->GetRenderIndex().GetRenderDelegate();
+    const float interactiveTargetFPS = renderDelegate->GetRenderSetting(
+           HdOSPRayRenderSettingsTokens->interactiveTargetFPS,
+           config.interactiveTargetFPS);
+    _maxResolution = (interactiveTargetFPS != 0)
+           ? int(config.interactiveDomeLightMaxResolution)
+           : 0;
 }
 
 void
@@ -54,11 +66,20 @@ HdOSPRayDomeLight::_PrepareOSPLight()
     upDirection = _transform.Transform(upDirection);
     centerDirection = _transform.Transform(centerDirection);
 
-    const auto& result = LoadOIIOTexture2D(_textureFile);
-    _hdriTexture = result.first;
+    HdOSPRayTextureKey key;
+    key.file = _textureFile;
+    key.maxResolution = _maxResolution;
+    // loaded synchronously, the hdri light builds its importance sampling
+    // distribution from the map at commit.  The texture cache keeps the map
+    // decoded across syncs, so only changing the file loads it again.
+    HdOSPRayCachedTexturePtr hdriTexture = _textureCache->GetTexture(key);
 
-    if (_hdriTexture) {
-        _ospLight = opp::Light("hdri");
+    if (hdriTexture) {
+        // the light is kept while its map is unchanged, other edits only
+        // update its parameters
+        if (!_ospLight || hdriTexture != _hdriTexture)
+            _ospLight = opp::Light("hdri");
+        _hdriTexture = hdriTexture;
         // placement
         _ospLight.setParam(
                "up", vec3f(upDirection[0], upDirection[1], upDirection[2]));
@@ -66,7 +87,7 @@ HdOSPRayDomeLight::_PrepareOSPLight()
                            vec3f(centerDirection[0], centerDirection[1],
                                  centerDirection[2]));
         // emission
-        _ospLight.setParam("map", _hdriTexture);
+        _ospLight.setParam("map", _hdriTexture->ospTexture);
         _ospLight.setParam("color",
                            vec3f(_emissionParam.color[0],
                                  _emissionParam.color[1],
@@ -75,7 +96,9 @@ HdOSPRayDomeLight::_PrepareOSPLight()
         _ospLight.setParam("visible", _cameraVisibility);
         _ospLight.commit();
     } else {
-        _ospLight = opp::Light("ambient");
+        if (!_ospLight || _hdriTexture)
+            _ospLight = opp::Light("ambient");
+        _hdriTexture = nullptr;
         _ospLight.setParam("color",
                            vec3f(_emissionParam.color[0],
                                  _emissionParam.color[1],
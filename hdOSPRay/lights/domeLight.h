@@ -4,6 +4,7 @@
 #pragma once
 
 #include "light.h"
+#include "../texture.h"
 
 PXR_NAMESPACE_USING_DIRECTIVE
 
@@ -23,8 +24,10 @@ protected:
     void _PrepareOSPLight() override;
 
 private:
-    // the loaded texture
-    opp::Texture _hdriTexture;
+    // the loaded texture, shared through the texture cache
+    HdOSPRayCachedTexturePtr _hdriTexture;
     // path to the lat/long texture file
     std::string _textureFile;
+    // resolution limit of the texture, 0 for full resolution
+    int _maxResolution { 0 };
 };
\ No newline at end of file
@@ -164,10 +164,14 @@ HdOSPRayLight::Sync(HdSceneDelegate* sceneDelegate, HdRenderParam* renderParam,
     }
 
 
+    _textureCache = &ospRenderParam->GetTextureCache();
+
     // query light type specific parameters
     _LightSpecificSync(sceneDelegate, id, dirtyBits);
 
-    // generate the OSPLight source
+    // generate the OSPLight source, lights that can be clustered set their
+    // proxy again
+    _hasProxy = false;
     _PrepareOSPLight();
 
     // populates the light source to the OSPRay renderer
@@ -185,6 +189,26 @@ HdOSPRayLight::_PopulateOSPLight(HdOSPRayRenderParam* ospRenderParam) const
     ospRenderParam->AddHdOSPRayLight(GetId(), this);
 }
 
+void
+HdOSPRayLight::_SetLightProxy(GfVec3f const& position, float radius,
+                              float area,
+                              OSPIntensityQuantity intensityQuantity,
+                              float intensity)
+{
+    // emitted power of a diffuse emitter, point lights emit their intensity
+    // into all directions
+    float power = intensity;
+    if (intensityQuantity == OSP_INTENSITY_QUANTITY_RADIANCE && area > 0.f)
+        power *= float(M_PI) * area;
+    else if (intensityQuantity != OSP_INTENSITY_QUANTITY_POWER)
+        power *= 4.f * float(M_PI);
+
+    _proxy.position = position;
+    _proxy.radius = radius;
+    _proxy.power = power * _emissionParam.color;
+    _hasProxy = true;
+}
+
 HdDirtyBits
 HdOSPRayLight::GetInitialDirtyBitsMask() const
 {
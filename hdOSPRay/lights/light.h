@@ -16,6 +16,8 @@
 
 #include <vector>
 
+#include "lightClusters.h"
+
 #include <ospray/ospray_cpp.h>
 #include <ospray/ospray_cpp/ext/rkcommon.h>
 
@@ -24,6 +26,7 @@ namespace opp = ospray::cpp;
 PXR_NAMESPACE_USING_DIRECTIVE
 
 class HdOSPRayRenderParam;
+class HdOSPRayTextureCache;
 
 /// \class HdOSPRayLight
 ///
@@ -57,6 +60,14 @@ public:
         return _ospLight;
     }
 
+    /// Returns true and sets \p proxy for local lights, which can be
+    /// replaced by light clusters.  Distant and dome lights return false.
+    inline bool GetLightProxy(HdOSPRayLightProxy& proxy) const
+    {
+        proxy = _proxy;
+        return _hasProxy;
+    }
+
 private:
     void _PopulateOSPLight(HdOSPRayRenderParam* ospRenderParam) const;
 
@@ -67,6 +78,12 @@ protected:
 
     virtual void _PrepareOSPLight() = 0;
 
+    // sets the cluster proxy from the emission of a light source with the
+    // given emitting surface area, 0 for point lights
+    void _SetLightProxy(GfVec3f const& position, float radius, float area,
+                        OSPIntensityQuantity intensityQuantity,
+                        float intensity);
+
     ///
     /// \struct EmissionParameter
     ///
@@ -110,6 +127,14 @@ protected:
     // if light source is visible to the camera
     bool _cameraVisibility { false };
 
-    // reference to the equivalent OSPLight
+    // reference to the equivalent OSPLight, updated in place across syncs
+    // so that the light list of the world stays unchanged
     opp::Light _ospLight;
+
+    // world space position and power of local lights
+    HdOSPRayLightProxy _proxy;
+    bool _hasProxy { false };
+
+    // delegate wide texture cache, set before _PrepareOSPLight is called
+    HdOSPRayTextureCache* _textureCache { nullptr };
 };
\ No newline at end of file
@@ -0,0 +1,218 @@
+// Copyright 2019 Intel Corporation
+// SPDX-License-Identifier: Apache-2.0
+
+#include "lightClusters.h"
+
+#include <algorithm>
+
+using namespace rkcommon::math;
+
+static float
+_Luminance(GfVec3f const& power)
+{
+    return 0.2126f * power[0] + 0.7152f * power[1] + 0.0722f * power[2];
+}
+
+// lower bound of squared distances, keeps the irradiance of point lights at
+// the camera finite
+static const float _minDistanceSq = 1e-8f;
+
+void
+HdOSPRayLightClusterTree::Build(std::vector<HdOSPRayLightProxy> const& proxies,
+                                std::vector<opp::Light> const& lights)
+{
+    _nodes.clear();
+    _cut.clear();
+    _pendingCut.clear();
+    for (uint32_t& node : _clusterNodes) {
+        if (node != _unusedNode)
+            node = _staleNode;
+    }
+    _lights = lights;
+    _numLights = proxies.size();
+    if (proxies.empty())
+        return;
+
+    std::vector<uint32_t> order(proxies.size());
+    for (size_t i = 0; i < order.size(); i++)
+        order[i] = uint32_t(i);
+    _nodes.reserve(2 * proxies.size() - 1);
+    _BuildNode(proxies, order, 0, uint32_t(order.size()));
+}
+
+uint32_t
+HdOSPRayLightClusterTree::_BuildNode(
+       std::vector<HdOSPRayLightProxy> const& proxies,
+       std::vector<uint32_t>& order, uint32_t begin, uint32_t end)
+{
+    const uint32_t index = uint32_t(_nodes.size());
+    _nodes.emplace_back();
+
+    _Node node;
+    node.begin = begin;
+    node.end = end;
+    GfVec3f weightedCenter(0.f);
+    for (uint32_t i = begin; i < end; i++) {
+        HdOSPRayLightProxy const& proxy = proxies[order[i]];
+        const GfVec3f extent(proxy.radius);
+        node.bounds.UnionWith(GfRange3f(proxy.position - extent,
+                                        proxy.position + extent));
+        const float luminance = _Luminance(proxy.power);
+        node.power += proxy.power;
+        node.luminance += luminance;
+        weightedCenter += luminance * proxy.position;
+    }
+    node.center = node.luminance > 0.f ? weightedCenter / node.luminance
+                                       : node.bounds.GetMidpoint();
+    node.light = order[begin];
+
+    // median split along the largest extent of the light positions
+    if (end - begin > 1) {
+        GfRange3f positions;
+        for (uint32_t i = begin; i < end; i++)
+            positions.UnionWith(proxies[order[i]].position);
+        const GfVec3f size = positions.GetSize();
+        int axis = 0;
+        if (size[1] > size[axis])
+            axis = 1;
+        if (size[2] > size[axis])
+            axis = 2;
+
+        const uint32_t middle = begin + (end - begin) / 2;
+        std::nth_element(order.begin() + begin, order.begin() + middle,
+                         order.begin() + end,
+                         [&proxies, axis](uint32_t a, uint32_t b) {
+                             return proxies[a].position[axis]
+                                    < proxies[b].position[axis];
+                         });
+        _BuildNode(proxies, order, begin, middle);
+        node.right = _BuildNode(proxies, order, middle, end);
+    }
+
+    _nodes[index] = node;
+    return index;
+}
+
+bool
+HdOSPRayLightClusterTree::UpdateCut(GfVec3f const& eye, float threshold)
+{
+    _pendingCut.clear();
+    if (_nodes.empty())
+        return _pendingCut != _cut;
+
+    // irradiance of all lights at the camera, estimated from the leaves
+    float totalIrradiance = 0.f;
+    for (_Node const& node : _nodes) {
+        if (node.right != 0)
+            continue;
+        const float radius = 0.5f * node.bounds.GetSize().GetLength();
+        const float distanceSq = (node.center - eye).GetLengthSq();
+        totalIrradiance += node.luminance
+               / std::max({ distanceSq, radius * radius, _minDistanceSq });
+    }
+    const float minIrradiance = threshold * threshold * totalIrradiance;
+
+    std::vector<uint32_t> stack(1, 0);
+    while (!stack.empty()) {
+        const uint32_t index = stack.back();
+        stack.pop_back();
+        _Node const& node = _nodes[index];
+        if (node.right == 0) {
+            if (node.luminance > 0.f)
+                _pendingCut.push_back(index);
+            continue;
+        }
+
+        // clusters containing the camera are always split
+        const float radius = 0.5f * node.bounds.GetSize().GetLength();
+        const float distance = (node.bounds.GetMidpoint() - eye).GetLength();
+        if (distance > radius) {
+            const float closest = distance - radius;
+            if (radius < threshold * distance
+                || node.luminance < minIrradiance * closest * closest) {
+                if (node.luminance > 0.f)
+                    _pendingCut.push_back(index);
+                continue;
+            }
+        }
+        stack.push_back(index + 1);
+        stack.push_back(node.right);
+    }
+    std::sort(_pendingCut.begin(), _pendingCut.end());
+    return _pendingCut != _cut;
+}
+
+bool
+HdOSPRayLightClusterTree::CommitCut()
+{
+    // clusters staying in the cut keep their light
+    std::vector<bool> inCut(_nodes.size(), false);
+    for (uint32_t index : _pendingCut)
+        inCut[index] = true;
+    std::vector<bool> placed(_nodes.size(), false);
+    std::vector<size_t> freeLights;
+    for (size_t i = 0; i < _clusterNodes.size(); i++) {
+        const uint32_t index = _clusterNodes[i];
+        if (index < _nodes.size() && inCut[index] && _nodes[index].right)
+            placed[index] = true;
+        else
+            freeLights.push_back(i);
+    }
+
+    // entering clusters reuse free lights first, leaves render with their
+    // own light
+    const size_t numClusterLights = _clusterLights.size();
+    std::vector<opp::Light> leafLights;
+    size_t nextFree = 0;
+    for (uint32_t index : _pendingCut) {
+        if (_nodes[index].right == 0) {
+            leafLights.push_back(_lights[_nodes[index].light]);
+            continue;
+        }
+        if (placed[index])
+            continue;
+        if (nextFree < freeLights.size()) {
+            const size_t light = freeLights[nextFree++];
+            _clusterNodes[light] = index;
+            _SetClusterLight(_clusterLights[light], index);
+        } else {
+            _clusterNodes.push_back(index);
+            _clusterLights.emplace_back("sphere");
+            _SetClusterLight(_clusterLights.back(), index);
+        }
+    }
+    for (; nextFree < freeLights.size(); nextFree++) {
+        const size_t light = freeLights[nextFree];
+        if (_clusterNodes[light] == _unusedNode)
+            continue;
+        _clusterNodes[light] = _unusedNode;
+        _clusterLights[light].setParam("intensity", 0.f);
+        _clusterLights[light].commit();
+    }
+    _cut = _pendingCut;
+
+    std::vector<opp::Light> cutLights = _clusterLights;
+    cutLights.insert(cutLights.end(), leafLights.begin(), leafLights.end());
+    bool changed = cutLights.size() != _cutLights.size();
+    for (size_t i = numClusterLights; !changed && i < cutLights.size(); i++)
+        changed = cutLights[i].handle() != _cutLights[i].handle();
+    _cutLights = std::move(cutLights);
+    return changed;
+}
+
+void
+HdOSPRayLightClusterTree::_SetClusterLight(opp::Light& light,
+                                           uint32_t index) const
+{
+    _Node const& node = _nodes[index];
+    const GfVec3f color = node.power / node.luminance;
+    const float radius = 0.25f * node.bounds.GetSize().GetLength();
+    light.setParam("position",
+                   vec3f(node.center[0], node.center[1], node.center[2]));
+    light.setParam("radius", radius);
+    light.setParam("intensityQuantity", OSP_INTENSITY_QUANTITY_POWER);
+    light.setParam("color", vec3f(color[0], color[1], color[2]));
+    light.setParam("intensity", node.luminance);
+    light.setParam("visible", false);
+    light.commit();
+}
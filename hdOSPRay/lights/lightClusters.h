@@ -0,0 +1,120 @@
+// Copyright 2019 Intel Corporation
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+
+#include <pxr/pxr.h>
+
+#include <pxr/base/gf/range3f.h>
+#include <pxr/base/gf/vec3f.h>
+
+#include <cstdint>
+#include <vector>
+
+#include <ospray/ospray_cpp.h>
+#include <ospray/ospray_cpp/ext/rkcommon.h>
+
+namespace opp = ospray::cpp;
+
+PXR_NAMESPACE_USING_DIRECTIVE
+
+/// \struct HdOSPRayLightProxy
+///
+/// World space position, extent and emitted power of a local light, used to
+/// cluster lights.
+///
+struct HdOSPRayLightProxy {
+    GfVec3f position { 0.f };
+    float radius { 0.f };
+    // emitted power in W per color channel
+    GfVec3f power { 0.f };
+};
+
+/// \class HdOSPRayLightClusterTree
+///
+/// Bounding volume hierarchy over local lights.  A cut through the
+/// hierarchy keeps nearby and bright clusters as individual lights and
+/// replaces clusters that are small from the camera position, or contribute
+/// little to the scene seen from it, by one sphere light emitting the power
+/// of the cluster.
+///
+/// Lights in the cut render with their own OSPRay light, so they keep their
+/// shape and direction.  The sphere lights of clusters persist and are
+/// reparameterized in place when the cut changes, so the light list of the
+/// world only changes if individual lights enter or leave the cut, or the
+/// cut holds more clusters than all previous cuts.
+///
+class HdOSPRayLightClusterTree {
+public:
+    /// Builds the hierarchy over lights, light i is described by
+    /// proxies[i].  The cluster lights are kept, the next CommitCut
+    /// reparameterizes all of them.
+    void Build(std::vector<HdOSPRayLightProxy> const& proxies,
+               std::vector<opp::Light> const& lights);
+
+    /// Computes the cut for camera position \p eye, returns true if it
+    /// differs from the committed cut.  A cluster is replaced by one light
+    /// if its radius to distance ratio is below \p threshold, or its
+    /// estimated irradiance at \p eye is below threshold squared of the
+    /// irradiance of all lights.
+    bool UpdateCut(GfVec3f const& eye, float threshold);
+
+    /// Commits the cut of the last UpdateCut to the cut lights.  Cluster
+    /// lights of nodes that left the cut are reused for clusters that
+    /// entered it, unused cluster lights emit nothing.  Returns true if the
+    /// list of cut lights changed.
+    bool CommitCut();
+
+    /// cluster lights followed by the individual lights of the committed
+    /// cut
+    std::vector<opp::Light> const& GetCutLights() const
+    {
+        return _cutLights;
+    }
+
+    size_t GetNumLights() const
+    {
+        return _numLights;
+    }
+
+private:
+    struct _Node {
+        GfRange3f bounds;
+        // power weighted center of the lights
+        GfVec3f center { 0.f };
+        GfVec3f power { 0.f };
+        float luminance { 0.f };
+        uint32_t begin { 0 };
+        uint32_t end { 0 };
+        // index of the second child, the first one follows the node.  0 for
+        // leaves.
+        uint32_t right { 0 };
+        // index of the light of leaves
+        uint32_t light { 0 };
+    };
+
+    // builds the subtree over order[begin, end) and returns its index
+    uint32_t _BuildNode(std::vector<HdOSPRayLightProxy> const& proxies,
+                        std::vector<uint32_t>& order, uint32_t begin,
+                        uint32_t end);
+
+    // sets the parameters of the sphere light representing a cluster
+    void _SetClusterLight(opp::Light& light, uint32_t node) const;
+
+    // _clusterNodes entry of a light emitting nothing, and of a light still
+    // set up for a node of the previous build
+    static constexpr uint32_t _unusedNode = UINT32_MAX;
+    static constexpr uint32_t _staleNode = UINT32_MAX - 1;
+
+    std::vector<_Node> _nodes;
+    std::vector<opp::Light> _lights;
+    size_t _numLights { 0 };
+    // sorted nodes of the committed and of the last computed cut
+    std::vector<uint32_t> _cut;
+    std::vector<uint32_t> _pendingCut;
+    // cluster node represented by each cluster light
+    std::vector<uint32_t> _clusterNodes;
+    std::vector<opp::Light> _clusterLights;
+    // _clusterLights followed by the lights of the leaves in the cut
+    std::vector<opp::Light> _cutLights;
+};
@@ -102,7 +102,8 @@ HdOSPRayRectLight::_PrepareOSPLight()
                : OSP_INTENSITY_QUANTITY_RADIANCE;
     }
 
-    _ospLight = opp::Light("quad");
+    if (!_ospLight)
+        _ospLight = opp::Light("quad");
     // placement
     _ospLight.setParam(
            "position",
@@ -119,4 +120,10 @@ HdOSPRayRectLight::_PrepareOSPLight()
     _ospLight.setParam("intensity", _emissionParam.ExposedIntensity());
     _ospLight.setParam("visible", _cameraVisibility);
     _ospLight.commit();
+
+    const GfVec3f diagonal = osp_edge1 + osp_edge2;
+    _SetLightProxy(osp_position + 0.5f * diagonal,
+                   0.5f * diagonal.GetLength(),
+                   GfCross(osp_edge1, osp_edge2).GetLength(),
+                   intensityQuantity, _emissionParam.ExposedIntensity());
 }
\ No newline at end of file
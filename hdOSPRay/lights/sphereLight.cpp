@@ -62,7 +62,8 @@ HdOSPRaySphereLight::_PrepareOSPLight()
     // We could also consider scaling but is is not clear what to do
     // if the scaling i non-uniform
 
-    _ospLight = opp::Light("sphere");
+    if (!_ospLight)
+        _ospLight = opp::Light("sphere");
     _ospLight.setParam("position",
                        vec3f(position[0], position[1], position[2]));
     if (_treatAsPoint)
@@ -79,4 +80,8 @@ HdOSPRaySphereLight::_PrepareOSPLight()
     _ospLight.setParam("intensity", intensity);
     _ospLight.setParam("visible", _cameraVisibility);
     _ospLight.commit();
+
+    const float radius = _treatAsPoint ? 0.f : _radius;
+    _SetLightProxy(position, radius, 4.f * float(M_PI) * radius * radius,
+                   intensityQuantity, intensity);
 }
\ No newline at end of file
@@ -11,6 +11,8 @@
 
 #include "config.h"
 #include "context.h"
+#include "renderDelegate.h"
+#include "renderParam.h"
 
 #include <OpenImageIO/imageio.h>
 #include <pxr/imaging/hdSt/material.h>
@@ -54,14 +56,34 @@ TF_DEFINE_PRIVATE_TOKENS(
     (mirror)
     (rotation)
     (translation)
+    ((maxResolution, "ospray:maxResolution"))
 );
 
 // clang-format on
 
+// coat, transmission and metallic weights ignored by the material
+// simplification with final and preview fidelity
+static const float _finalSimplifyTolerance = 1e-3f;
+static const float _previewSimplifyTolerance = 0.1f;
+// roughness from which the phong lobe of the obj material stands in for the
+// specular lobe of a principled dielectric with final fidelity
+static const float _finalObjMinRoughness = 0.6f;
+
+// combines two resolution limits, 0 meaning unlimited
+static int
+_MinResolution(int a, int b)
+{
+    if (a <= 0)
+        return b;
+    if (b <= 0)
+        return a;
+    return std::min(a, b);
+}
+
 HdOSPRayMaterial::HdOSPRayMaterial(SdfPath const& id)
     : HdMaterial(id)
 {
-    diffuseColor = GfVec3f(1, 1, 1);
+    _ResetParameters();
 }
 
 void
@@ -71,7 +93,8 @@ HdOSPRayMaterial::Sync(HdSceneDelegate* sceneDelegate,
     HD_TRACE_FUNCTION();
     HF_MALLOC_TAG_FUNCTION();
 
-    TF_UNUSED(renderParam);
+    HdOSPRayRenderParam* ospRenderParam
+           = static_cast<HdOSPRayRenderParam*>(renderParam);
 
     // if material dirty, update
     if (*dirtyBits & HdMaterial::DirtyResource) {
@@ -82,6 +105,20 @@ HdOSPRayMaterial::Sync(HdSceneDelegate* sceneDelegate,
                = networkMapResource.Get<HdMaterialNetworkMap>();
         HdMaterialNetwork matNetwork;
 
+        // textures of materials synced while interactive load reduced
+        // resolutions
+        const HdOSPRayConfig& config = HdOSPRayConfig::GetInstance();
+        int maxTextureResolution = config.textureMaxResolution;
+        HdRenderDelegate* renderDelegate
+               = sceneDelegate->GetRenderIndex().GetRenderDelegate();
+        const float interactiveTargetFPS = renderDelegate->GetRenderSetting(
+               HdOSPRayRenderSettingsTokens->interactiveTargetFPS,
+               config.interactiveTargetFPS);
+        if (interactiveTargetFPS != 0)
+            maxTextureResolution = _MinResolution(
+                   maxTextureResolution,
+                   config.interactiveTextureMaxResolution);
+
         TF_FOR_ALL (itr, networkMap.map) {
             auto& network = itr->second;
             TF_FOR_ALL (node, network.nodes) {
@@ -91,6 +128,14 @@ HdOSPRayMaterial::Sync(HdSceneDelegate* sceneDelegate,
             }
         }
 
+        // parameters are gathered anew from the network, so that removed
+        // inputs and textures fall back to their defaults.  Textures whose
+        // file and load parameters did not change are taken over from
+        // _previousTextures instead of being fetched again.
+        _ResetParameters();
+        _previousTextures.swap(_textures);
+        _textures.clear();
+
         // process each material node based on type
         TF_FOR_ALL (node, matNetwork.nodes) {
             if (node->identifier == HdOSPRayMaterialTokens->UsdPreviewSurface)
@@ -113,7 +158,9 @@ HdOSPRayMaterial::Sync(HdSceneDelegate* sceneDelegate,
 
                 TfToken inputNameToken = relationship->inputName;
                 TfToken texNameToken = relationship->outputName;
-                _ProcessTextureNode(*node, inputNameToken, texNameToken);
+                _ProcessTextureNode(*node, inputNameToken, texNameToken,
+                                    ospRenderParam->GetTextureCache(),
+                                    maxTextureResolution);
             } else if (node->identifier
                        == HdOSPRayMaterialTokens->UsdTransform2d) {
                 // calculate transform2d to be used on a texture
@@ -142,30 +189,151 @@ HdOSPRayMaterial::Sync(HdSceneDelegate* sceneDelegate,
             }
         }
 
-        _UpdateOSPRayMaterial();
+        _previousTextures.clear();
+
+        // only edits that changed OSPRay parameters restart accumulation
+        opp::Material previousMaterial = _ospMaterial;
+        const bool previewMaterials = renderDelegate->GetRenderSetting(
+               HdOSPRayRenderSettingsTokens->previewMaterials,
+               config.previewMaterials);
+        bool materialChanged = _UpdateOSPRayMaterial(
+               ospRenderParam->GetMaterialCache(), previewMaterials);
+        if (_ospMaterial.handle() != previousMaterial.handle()) {
+            // a new material object, re-point the geometric models bound to
+            // this material
+            ospRenderParam->UpdateMaterialBindings(GetId(), _ospMaterial);
+        }
+        if (materialChanged)
+            ospRenderParam->UpdateMaterialVersion();
 
         *dirtyBits = Clean;
     }
 }
 
 void
-HdOSPRayMaterial::_UpdateOSPRayMaterial()
+HdOSPRayMaterial::_ResetParameters()
 {
-    std::string rendererType = HdOSPRayConfig::GetInstance().usePathTracing
-           ? "pathtracer"
-           : "scivis";
+    diffuseColor = GfVec3f(1, 1, 1);
+    specularColor = GfVec3f(0.f, 0.f, 0.f);
+    metallic = 0.f;
+    roughness = 0.5f;
+    coatRoughness = 0.01f;
+    coat = 0.f;
+    ior = 1.5f;
+    opacity = 1.f;
+    hasPtex = false;
+}
 
-    if (rendererType == "pathtracer") {
-        if (!HdOSPRayConfig::GetInstance().useSimpleMaterial) {
-            _ospMaterial = CreatePrincipledMaterial(rendererType);
-        } else {
-            _ospMaterial = CreateSimpleMaterial(rendererType);
-        }
+std::string
+HdOSPRayMaterial::_SimplifiedMaterialType(bool preview) const
+{
+    const float tolerance
+           = preview ? _previewSimplifyTolerance : _finalSimplifyTolerance;
+    auto hasTexture = [this](TfToken const& name) {
+        auto texture = _textures.find(name);
+        return texture != _textures.end() && texture->second.ospTexture;
+    };
+
+    // spatially varying weights are not analyzed
+    if (hasTexture(HdOSPRayMaterialTokens->metallic)
+        || hasTexture(HdOSPRayMaterialTokens->opacity))
+        return "principled";
+    // coat and transmission need the layers of the principled material
+    if (coat > tolerance || opacity < 1.f - tolerance)
+        return "principled";
+    if (metallic >= 1.f - tolerance)
+        return "alloy";
+    if (metallic > tolerance)
+        return "principled";
+    // obj has no roughness map, also not with preview fidelity
+    if (!hasTexture(HdOSPRayMaterialTokens->roughness)
+        && (preview || roughness >= _finalObjMinRoughness))
+        return "obj";
+    return "principled";
+}
+
+bool
+HdOSPRayMaterial::_UpdateOSPRayMaterial(HdOSPRayMaterialCache& materialCache,
+                                        bool previewMaterials)
+{
+    const HdOSPRayConfig& config = HdOSPRayConfig::GetInstance();
+    std::string rendererType = config.usePathTracing ? "pathtracer" : "scivis";
+    std::string materialType = "obj";
+
+    _params.clear();
+    if (rendererType != "pathtracer") {
+        _SetScivisParams();
+    } else if (config.useSimpleMaterial) {
+        _SetSimpleParams();
     } else {
-        _ospMaterial = CreateScivisMaterial(rendererType);
+        materialType = config.simplifyMaterials
+               ? _SimplifiedMaterialType(previewMaterials)
+               : "principled";
+        if (materialType == "alloy")
+            _SetAlloyParams();
+        else if (materialType == "obj")
+            _SetDielectricParams();
+        else
+            _SetPrincipledParams();
     }
 
-    _ospMaterial.commit();
+    // identifies the material by its types and parameter values
+    std::string key = rendererType + "/" + materialType;
+    for (const auto& [name, param] : _params) {
+        key += '\0' + name + '=';
+        key.append(param.value.begin(), param.value.end());
+    }
+    if (_materialEntry && _materialEntry->key == key)
+        return false;
+
+    // a material not shared with other materials is edited in place, so
+    // geometries referencing it see edits without being recommitted
+    if (_materialEntry && _ospMaterialType == materialType
+        && materialCache.Rekey(_materialEntry, key)) {
+        // parameters not set by this update, e.g. maps of removed textures
+        for (auto it = _ospParams.begin(); it != _ospParams.end();) {
+            if (_params.count(it->first)) {
+                ++it;
+                continue;
+            }
+            _ospMaterial.removeParam(it->first.c_str());
+            it = _ospParams.erase(it);
+        }
+        for (const auto& [name, param] : _params) {
+            std::vector<unsigned char>& value = _ospParams[name];
+            if (value != param.value) {
+                param.set(_ospMaterial);
+                value = param.value;
+            }
+        }
+        _ospMaterial.commit();
+        return true;
+    }
+
+    _materialEntry = materialCache.GetMaterial(key, [&]() {
+        opp::Material material(rendererType.c_str(), materialType.c_str());
+        for (const auto& param : _params)
+            param.second.set(material);
+        material.commit();
+        return material;
+    });
+    _ospMaterial = _materialEntry->material;
+    _ospMaterialType = materialType;
+    _ospParams.clear();
+    for (const auto& [name, param] : _params)
+        _ospParams[name] = param.value;
+    return true;
+}
+
+void
+HdOSPRayMaterial::_SetParam(std::string const& name, const void* value,
+                            size_t size,
+                            std::function<void(opp::Material&)> set)
+{
+    const unsigned char* bytes = static_cast<const unsigned char*>(value);
+    _Param& param = _params[name];
+    param.value.assign(bytes, bytes + size);
+    param.set = std::move(set);
 }
 
 void
@@ -196,7 +364,9 @@ HdOSPRayMaterial::_ProcessUsdPreviewSurfaceNode(HdMaterialNode node)
 
 void
 HdOSPRayMaterial::_ProcessTextureNode(HdMaterialNode node, TfToken inputName,
-                                      TfToken outputName)
+                                      TfToken outputName,
+                                      HdOSPRayTextureCache& textureCache,
+                                      int maxResolution)
 {
     bool isPtex = node.identifier == HdOSPRayMaterialTokens->HwPtexTexture_1;
     bool isUdim = false;
@@ -204,6 +374,8 @@ HdOSPRayMaterial::_ProcessTextureNode(HdMaterialNode node, TfToken inputName,
     if (_textures.find(outputName) == _textures.end())
         _textures[outputName] = HdOSPRayTexture();
     HdOSPRayTexture& texture = _textures[outputName];
+    // texture of the same output from the previous sync, if any
+    auto previous = _previousTextures.find(outputName);
     std::string filename = "";
     TF_FOR_ALL (param, node.parameters) {
         const auto& name = param->first;
@@ -218,6 +390,9 @@ HdOSPRayMaterial::_ProcessTextureNode(HdMaterialNode node, TfToken inputName,
         } else if (name == HdOSPRayMaterialTokens->wrapS) {
         } else if (name == HdOSPRayMaterialTokens->wrapT) {
         } else if (name == HdOSPRayMaterialTokens->sourceColorSpace) {
+        } else if (name == HdOSPRayMaterialTokens->maxResolution) {
+            if (value.IsHolding<int>())
+                maxResolution = value.UncheckedGet<int>();
         } else {
             TF_CODING_ERROR("unhandled token: %s\n", name.GetString().c_str());
         }
@@ -230,30 +405,50 @@ HdOSPRayMaterial::_ProcessTextureNode(HdMaterialNode node, TfToken inputName,
             hasPtex = true;
             texture.isPtex = true;
 #ifdef HDOSPRAY_PLUGIN_PTEX
-            texture.ospTexture = LoadPtexTexture(texture.file);
+            if (previous != _previousTextures.end() && previous->second.isPtex
+                && previous->second.file == texture.file) {
+                texture.ospTexture = previous->second.ospTexture;
+            } else {
+                texture.ospTexture = LoadPtexTexture(texture.file);
+                if (texture.ospTexture)
+                    texture.ospTexture.commit();
+            }
 #endif
-        } else if (isUdim) {
-            int numX, numY;
-            const auto& result = LoadUDIMTexture2D(
-                   texture.file, numX, numY, false,
-                   (outputName == HdOSPRayMaterialTokens->opacity));
-            texture.ospTexture = result.first;
-            texture.hasXfm = true;
-            texture.xfm_scale = { 1.f / float(numX), 1.f / float(numY) };
-            // OSPRay scales around the center (0.5, 0.5).  translate
-            // texture from (0.5, 0.5) to (0,0)
-            texture.xfm_translation
-                   = { -(.5f - .5f / float(numX)), -(.5f - .5f / float(numY)) };
         } else {
-            const auto& result = LoadOIIOTexture2D(
-                   texture.file, inputName.GetString(), false,
-                   (outputName == HdOSPRayMaterialTokens->opacity));
-            texture.ospTexture = result.first;
+            HdOSPRayTextureKey key;
+            key.file = texture.file;
+            if (!isUdim)
+                key.channels = inputName.GetString();
+            key.complement = (outputName == HdOSPRayMaterialTokens->opacity);
+            key.maxResolution = std::max(0, maxResolution);
+            if (previous != _previousTextures.end()
+                && previous->second.cachedTexture
+                && previous->second.key == key)
+                texture.cachedTexture = previous->second.cachedTexture;
+            else
+                texture.cachedTexture = textureCache.GetTexture(key, true);
+            texture.key = key;
+            texture.ospTexture = nullptr;
+            if (texture.cachedTexture)
+                texture.ospTexture = texture.cachedTexture->ospTexture;
+            if (isUdim && texture.cachedTexture) {
+                HdOSPRayUDIMLayout const& layout
+                       = texture.cachedTexture->texels.udimLayout;
+                const int firstX = layout.firstX;
+                const int firstY = layout.firstY;
+                const int numX = layout.numX;
+                const int numY = layout.numY;
+                texture.hasXfm = true;
+                texture.xfm_scale = { 1.f / float(numX), 1.f / float(numY) };
+                // OSPRay scales around the center (0.5, 0.5).  translate
+                // texture from (0.5, 0.5) to (0,0), and the first tile of
+                // the atlas to the origin
+                texture.xfm_translation
+                       = { -(.5f - .5f / float(numX)) - firstX / float(numX),
+                           -(.5f - .5f / float(numY)) - firstY / float(numY) };
+            }
         }
     }
-
-    if (texture.ospTexture)
-        texture.ospTexture.commit();
 }
 
 void
@@ -279,14 +474,6 @@ HdOSPRayMaterial::_ProcessTransform2dNode(HdMaterialNode node,
     }
 }
 
-void
-HdOSPRayMaterial::SetDisplayColor(GfVec4f color)
-{
-    diffuseColor = GfVec3f(color[0], color[1], color[2]);
-    opacity = color[3];
-    _UpdateOSPRayMaterial();
-}
-
 opp::Material
 HdOSPRayMaterial::CreateDefaultMaterial(GfVec4f color)
 {
@@ -312,14 +499,11 @@ HdOSPRayMaterial::CreateDefaultMaterial(GfVec4f color)
     return ospMaterial;
 }
 
-opp::Material
-HdOSPRayMaterial::CreatePrincipledMaterial(std::string rendererType)
+void
+HdOSPRayMaterial::_SetPrincipledParams()
 {
-    opp::Material ospMaterial
-           = opp::Material(rendererType.c_str(), "principled");
-    ospMaterial.setParam(
-           "baseColor",
-           vec3f(diffuseColor[0], diffuseColor[1], diffuseColor[2]));
+    _SetParam("baseColor",
+              vec3f(diffuseColor[0], diffuseColor[1], diffuseColor[2]));
     bool hasMetallicTex = false;
     bool hasRoughnessTex = false;
     bool hasOpacityTex = false;
@@ -341,101 +525,185 @@ HdOSPRayMaterial::CreatePrincipledMaterial(std::string rendererType)
             hasOpacityTex = true;
         }
 
-        if (name != "") {
-            ospMaterial.setParam(name.c_str(), value.ospTexture);
-            if (value.hasXfm) {
-                std::string st_translation = name + ".translation";
-                std::string st_scale = name + ".scale";
-                std::string st_rotation = name + ".rotation";
-                ospMaterial.setParam(st_translation.c_str(),
-                                     vec2f(-value.xfm_translation[0],
-                                           -value.xfm_translation[1]));
-                ospMaterial.setParam(st_scale.c_str(),
-                                     vec2f(1.0f / value.xfm_scale[0],
-                                           1.0f / value.xfm_scale[1]));
-                ospMaterial.setParam(st_rotation.c_str(), -value.xfm_rotation);
-            }
-        }
+        if (name != "")
+            _SetTextureParams(name, value);
     }
 
     // set material params
-    ospMaterial.setParam("metallic", (hasMetallicTex ? 1.0f : metallic));
-    ospMaterial.setParam("roughness", (hasRoughnessTex ? 1.0f : roughness));
-    ospMaterial.setParam("coat", coat);
-    ospMaterial.setParam("coatRoughness", coatRoughness);
-    ospMaterial.setParam("ior", ior);
-    ospMaterial.setParam("transmission",
-                         (hasOpacityTex ? 1.0f : 1.0f - opacity));
-    ospMaterial.setParam("thin", true);
-    ospMaterial.commit();
+    _SetParam("metallic", (hasMetallicTex ? 1.0f : metallic));
+    _SetParam("roughness", (hasRoughnessTex ? 1.0f : roughness));
+    _SetParam("coat", coat);
+    _SetParam("coatRoughness", coatRoughness);
+    _SetParam("ior", ior);
+    _SetParam("transmission", (hasOpacityTex ? 1.0f : 1.0f - opacity));
+    _SetParam("thin", true);
+}
 
-    return ospMaterial;
+void
+HdOSPRayMaterial::_SetAlloyParams()
+{
+    _SetParam("color",
+              vec3f(diffuseColor[0], diffuseColor[1], diffuseColor[2]));
+    _SetParam("edgeColor", vec3f(1.0f, 1.0f, 1.0f));
+    bool hasRoughnessTex = false;
+    for (const auto& [key, value] : _textures) {
+        if (!value.ospTexture)
+            continue;
+        if (key == HdOSPRayMaterialTokens->diffuseColor)
+            _SetTextureParams("map_color", value);
+        else if (key == HdOSPRayMaterialTokens->roughness) {
+            _SetTextureParams("map_roughness", value);
+            hasRoughnessTex = true;
+        }
+    }
+    _SetParam("roughness", (hasRoughnessTex ? 1.0f : roughness));
 }
 
-opp::Material
-HdOSPRayMaterial::CreateSimpleMaterial(std::string rendererType)
+void
+HdOSPRayMaterial::_SetDielectricParams()
 {
-    opp::Material ospMaterial = opp::Material(rendererType.c_str(), "obj");
+    // diffuse base and a phong lobe with the average fresnel reflectance of
+    // the principled dielectric
     float avgFresnel = EvalAvgFresnel(ior);
+    _SetParam("kd",
+              vec3f(diffuseColor[0], diffuseColor[1], diffuseColor[2])
+                     * (1.0f - avgFresnel));
+    _SetParam("ks", vec3f(avgFresnel, avgFresnel, avgFresnel));
+    _SetParam("ns", RoughnesToPhongExponent(std::sqrt(roughness)));
+    auto diffuseTexture = _textures.find(HdOSPRayMaterialTokens->diffuseColor);
+    if (diffuseTexture != _textures.end() && diffuseTexture->second.ospTexture)
+        _SetTextureParams("map_kd", diffuseTexture->second);
+}
+
+void
+HdOSPRayMaterial::_SetTextureParams(std::string const& name,
+                                    HdOSPRayTexture const& texture)
+{
+    _SetParam(name, texture.ospTexture);
+    if (texture.hasXfm) {
+        _SetParam(name + ".translation",
+                  vec2f(-texture.xfm_translation[0],
+                        -texture.xfm_translation[1]));
+        _SetParam(name + ".scale",
+                  vec2f(1.0f / texture.xfm_scale[0],
+                        1.0f / texture.xfm_scale[1]));
+        _SetParam(name + ".rotation", -texture.xfm_rotation);
+    }
+}
+
+void
+HdOSPRayMaterial::_SetSimpleParams()
+{
+    float avgFresnel = EvalAvgFresnel(ior);
+    vec3f kd(0.0f, 0.0f, 0.0f);
+    vec3f ks(specularColor[0], specularColor[1], specularColor[2]);
 
     if (metallic == 0.f) {
-        ospMaterial.setParam(
-               "kd",
-               vec3f(diffuseColor[0], diffuseColor[1], diffuseColor[2])
-                      * (1.0f - avgFresnel));
-        ospMaterial.setParam(
-               "ks",
-               vec3f(specularColor[0], specularColor[1], specularColor[2])
-                      * avgFresnel);
-        ospMaterial.setParam("ns",
-                             RoughnesToPhongExponent(std::sqrt(roughness)));
-    } else {
-        ospMaterial.setParam("kd", vec3f(0.0f, 0.0f, 0.0f));
-        ospMaterial.setParam(
-               "ks",
-               vec3f(specularColor[0], specularColor[1], specularColor[2]));
-        ospMaterial.setParam("ns",
-                             RoughnesToPhongExponent(std::sqrt(roughness)));
+        kd = vec3f(diffuseColor[0], diffuseColor[1], diffuseColor[2])
+               * (1.0f - avgFresnel);
+        ks = ks * avgFresnel;
     }
 
     if (opacity < 1.0f) {
         float tf = 1.0f - opacity;
-        ospMaterial.setParam("kd", vec3f(0.0f, 0.0f, 0.0f));
-        ospMaterial.setParam(
+        kd = vec3f(0.0f, 0.0f, 0.0f);
+        _SetParam(
                "tf",
                vec3f(diffuseColor[0], diffuseColor[1], diffuseColor[2]) * tf);
     }
+    _SetParam("kd", kd);
+    _SetParam("ks", ks);
+    _SetParam("ns", RoughnesToPhongExponent(std::sqrt(roughness)));
     if (_textures.find(HdOSPRayMaterialTokens->diffuseColor)
         != _textures.end()) {
         opp::Texture ospMapDiffuseTex
                = _textures[HdOSPRayMaterialTokens->diffuseColor].ospTexture;
         if (ospMapDiffuseTex) {
-            ospMaterial.setParam("map_kd", ospMapDiffuseTex);
+            _SetParam("map_kd", ospMapDiffuseTex);
             diffuseColor = GfVec3f(1.0);
         }
     }
-    ospMaterial.commit();
-    return ospMaterial;
 }
 
-opp::Material
-HdOSPRayMaterial::CreateScivisMaterial(std::string rendererType)
+void
+HdOSPRayMaterial::_SetScivisParams()
 {
-    opp::Material ospMaterial = opp::Material(rendererType.c_str(), "obj");
-    ospMaterial.setParam("ns", 10.f);
-    ospMaterial.setParam("ks", vec3f(0.2f, 0.2f, 0.2f));
-    ospMaterial.setParam(
-           "kd", vec3f(diffuseColor[0], diffuseColor[1], diffuseColor[2]));
+    _SetParam("ns", 10.f);
+    _SetParam("ks", vec3f(0.2f, 0.2f, 0.2f));
+    _SetParam("kd",
+              vec3f(diffuseColor[0], diffuseColor[1], diffuseColor[2]));
     if (_textures.find(HdOSPRayMaterialTokens->diffuseColor)
         != _textures.end()) {
         opp::Texture ospMapDiffuseTex
                = _textures[HdOSPRayMaterialTokens->diffuseColor].ospTexture;
         if (ospMapDiffuseTex) {
-            ospMaterial.setParam("map_kd", ospMapDiffuseTex);
+            _SetParam("map_kd", ospMapDiffuseTex);
             diffuseColor = GfVec3f(1.0);
         }
     }
-    ospMaterial.setParam("d", opacity);
-    ospMaterial.commit();
-    return ospMaterial;
-}
\ No newline at end of file
+    _SetParam("d", opacity);
+}
+HdOSPRayMaterialCache::EntryPtr
+HdOSPRayMaterialCache::GetMaterial(
+       std::string const& key, std::function<opp::Material()> const& create)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    std::weak_ptr<Entry>& interned = _entries[key];
+    EntryPtr entry = interned.lock();
+    if (entry)
+        return entry;
+
+    entry = std::make_shared<Entry>();
+    entry->material = create();
+    entry->key = key;
+    interned = entry;
+
+    if (_entries.size() >= _purgeSize) {
+        for (auto it = _entries.begin(); it != _entries.end();) {
+            if (it->second.expired())
+                it = _entries.erase(it);
+            else
+                ++it;
+        }
+        _purgeSize = std::max(size_t(64), 2 * _entries.size());
+    }
+    return entry;
+}
+
+bool
+HdOSPRayMaterialCache::Rekey(EntryPtr const& entry, std::string const& key)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (entry.use_count() > 1)
+        return false;
+    auto interned = _entries.find(key);
+    if (interned != _entries.end() && !interned->second.expired())
+        return false;
+
+    _entries.erase(entry->key);
+    entry->key = key;
+    _entries[key] = entry;
+    return true;
+}
+
+opp::Material
+HdOSPRayMaterialCache::GetDefaultMaterial(GfVec4f const& color)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    opp::Material& material
+           = _defaultMaterials[{ color[0], color[1], color[2], color[3] }];
+    if (!material)
+        material = HdOSPRayMaterial::CreateDefaultMaterial(color);
+    return material;
+}
+
+void
+HdOSPRayMaterialBinding::Apply()
+{
+    for (auto& model : models) {
+        if (materials.size() == 1)
+            model.setParam("material", materials[0]);
+        else
+            model.setParam("material", opp::CopiedData(materials));
+    }
+}
@@ -13,12 +13,77 @@
 #include <ospray/ospray_cpp.h>
 #include <ospray/ospray_cpp/ext/rkcommon.h>
 
+#include "texture.h"
+
+#include <array>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
 namespace opp = ospray::cpp;
 
 PXR_NAMESPACE_USING_DIRECTIVE
 
 typedef std::shared_ptr<class HdStTextureResource> HdStTextureResourceSharedPtr;
 
+/// \class HdOSPRayMaterialCache
+///
+/// Delegate wide table of interned OSPRay materials.  Materials with equal
+/// renderer type, material type and parameter values, including the
+/// handles of their textures, share one OSPRay material.  Entries are held
+/// by the materials using them and dropped once none does.  Default
+/// materials of prims without a bound material are shared by color.
+///
+class HdOSPRayMaterialCache {
+public:
+    struct Entry {
+        opp::Material material;
+        std::string key;
+    };
+    using EntryPtr = std::shared_ptr<Entry>;
+
+    /// thread safe.  Returns the material interned under \p key, created
+    /// and committed by \p create if no material is interned under it.
+    EntryPtr GetMaterial(std::string const& key,
+                         std::function<opp::Material()> const& create);
+
+    /// thread safe.  Interns \p entry under \p key instead of its current
+    /// key, so that its material can be edited in place.  Fails if anyone
+    /// else holds \p entry or another material is interned under \p key.
+    bool Rekey(EntryPtr const& entry, std::string const& key);
+
+    /// thread safe.  Returns the shared default material of \p color.
+    opp::Material GetDefaultMaterial(GfVec4f const& color);
+
+private:
+    std::mutex _mutex;
+    std::unordered_map<std::string, std::weak_ptr<Entry>> _entries;
+    // number of entries at which expired ones are purged
+    size_t _purgeSize { 64 };
+    std::map<std::array<float, 4>, opp::Material> _defaultMaterials;
+};
+
+/// \struct HdOSPRayMaterialBinding
+///
+/// Materials referenced by the geometric models of a prim.  Models with more
+/// than one material slot select the slot of each primitive with their
+/// "index" array.
+///
+struct HdOSPRayMaterialBinding {
+    /// bound material of each slot, empty for the default material
+    std::vector<SdfPath> materialIds;
+    /// OSPRay material of each slot
+    std::vector<opp::Material> materials;
+    std::vector<opp::GeometricModel> models;
+
+    /// sets the materials on all models, which still need to be committed
+    void Apply();
+};
+
 /// OSPRay hdMaterial
 ///  supports uvtextures and ptex when pxr_oiio_plugin
 ///  and pxr_ptex_plugin are enabled.
@@ -28,7 +93,7 @@ class HdOSPRayMaterial final : public HdMaterial {
 public:
     HdOSPRayMaterial(SdfPath const& id);
 
-    // TODO: free texture memory
+    /// textures are released through the texture cache
     virtual ~HdOSPRayMaterial() = default;
 
     /// Synchronizes state from the delegate to this object.
@@ -49,23 +114,12 @@ public:
     {
     }
 
-    void SetDisplayColor(GfVec4f color);
-
     /// Create a default material based on the renderer type specified in config
     static opp::Material CreateDefaultMaterial(GfVec4f color);
 
     /// Create a default material based on the renderer type specified in config
     // static OSPMaterial CreateDiffuseMaterial(GfVec4f color);
 
-    /// Create a default material based on the renderer type specified in config
-    opp::Material CreatePrincipledMaterial(std::string renderType);
-
-    /// Create a default material based on the renderer type specified in config
-    opp::Material CreateSimpleMaterial(std::string renderType);
-
-    /// Create a default material based on the renderer type specified in config
-    opp::Material CreateScivisMaterial(std::string renderType);
-
     /// Summary flag. Returns true if the material is bound to one or more
     /// textures and any of those textures is a ptex texture.
     /// If no textures are bound or all textures are uv textures, then
@@ -106,17 +160,6 @@ private:
     }
 
 protected:
-    // update osp representations for material
-    void _UpdateOSPRayMaterial();
-    // fill in material parameters based on usdPreviewSurface node
-    void _ProcessUsdPreviewSurfaceNode(HdMaterialNode node);
-    // parse texture node params and set them to appropriate map_ texture var
-    void _ProcessTextureNode(HdMaterialNode node, TfToken inputName,
-                             TfToken outputName);
-    // parse texture transformation node params and set rotation, translation,
-    // and scale
-    void _ProcessTransform2dNode(HdMaterialNode node, TfToken textureName);
-
     struct HdOSPRayTexture {
         std::string file;
         enum class WrapType { NONE, BLACK, CLAMP, REPEAT, MIRROR };
@@ -129,9 +172,66 @@ protected:
         enum class ColorType { NONE, RGBA, RGB, R, G, B, A };
         ColorType type;
         opp::Texture ospTexture { nullptr };
+        // keeps ospTexture alive in the texture cache
+        HdOSPRayCachedTexturePtr cachedTexture;
+        // cache key cachedTexture was requested with
+        HdOSPRayTextureKey key;
         bool isPtex { false };
     };
 
+    // update osp representations for material, returns true if any OSPRay
+    // parameter changed.  Identical materials are shared through
+    // materialCache.
+    bool _UpdateOSPRayMaterial(HdOSPRayMaterialCache& materialCache,
+                               bool previewMaterials);
+    // cheapest path tracer material type reproducing the material, with
+    // preview or final fidelity
+    std::string _SimplifiedMaterialType(bool preview) const;
+    // collect the parameters of the principled, simple path tracer, scivis,
+    // and simplified alloy and obj materials into _params
+    void _SetPrincipledParams();
+    void _SetSimpleParams();
+    void _SetScivisParams();
+    void _SetAlloyParams();
+    void _SetDielectricParams();
+    // records texture as map name, with its transform
+    void _SetTextureParams(std::string const& name,
+                           HdOSPRayTexture const& texture);
+    // records a parameter of the OSPRay material
+    template <typename T>
+    void _SetParam(std::string const& name, T const& value)
+    {
+        _SetParam(name, &value, sizeof(T),
+                  [name, value](opp::Material& material) {
+                      material.setParam(name.c_str(), value);
+                  });
+    }
+    // textures are identified by their handle
+    void _SetParam(std::string const& name, opp::Texture const& texture)
+    {
+        OSPTexture handle = texture.handle();
+        _SetParam(name, &handle, sizeof(handle),
+                  [name, texture](opp::Material& material) {
+                      material.setParam(name.c_str(), texture);
+                  });
+    }
+    void _SetParam(std::string const& name, const void* value, size_t size,
+                   std::function<void(opp::Material&)> set);
+    // reset the usdPreviewSurface parameters to their defaults
+    void _ResetParameters();
+    // fill in material parameters based on usdPreviewSurface node
+    void _ProcessUsdPreviewSurfaceNode(HdMaterialNode node);
+    // parse texture node params and set them to appropriate map_ texture var
+    // maxResolution limits the loaded resolution unless the node overrides
+    // it, 0 for full resolution
+    void _ProcessTextureNode(HdMaterialNode node, TfToken inputName,
+                             TfToken outputName,
+                             HdOSPRayTextureCache& textureCache,
+                             int maxResolution);
+    // parse texture transformation node params and set rotation, translation,
+    // and scale
+    void _ProcessTransform2dNode(HdMaterialNode node, TfToken textureName);
+
     GfVec3f diffuseColor { 0.18f, 0.18f, 0.18f };
     GfVec3f specularColor { 0.0f, 0.0f, 0.0f };
     float metallic { 0.f };
@@ -149,5 +249,21 @@ protected:
     GfVec2f _translation;
 
     std::map<TfToken, HdOSPRayTexture> _textures;
+    // textures of the previous sync, while the network is processed
+    std::map<TfToken, HdOSPRayTexture> _previousTextures;
     opp::Material _ospMaterial;
+    // interned entry of _ospMaterial
+    HdOSPRayMaterialCache::EntryPtr _materialEntry;
+    // "principled", "alloy" or "obj", the OSPRay type of _ospMaterial
+    std::string _ospMaterialType;
+    // values of the parameters set on _ospMaterial
+    std::map<std::string, std::vector<unsigned char>> _ospParams;
+
+    // parameter value and the function setting it on an OSPRay material
+    struct _Param {
+        std::vector<unsigned char> value;
+        std::function<void(opp::Material&)> set;
+    };
+    // parameters collected by the current update
+    std::map<std::string, _Param> _params;
 };
\ No newline at end of file
@@ -14,6 +14,8 @@
 
 #include <rkcommon/math/AffineSpace.h>
 
+#include <algorithm>
+
 using namespace rkcommon::math;
 
 // clang-format off
@@ -47,6 +49,21 @@ HdOSPRayMesh::~HdOSPRayMesh()
 void
 HdOSPRayMesh::Finalize(HdRenderParam* renderParam)
 {
+    HdOSPRayRenderParam* ospRenderParam
+           = static_cast<HdOSPRayRenderParam*>(renderParam);
+    ospRenderParam->RemoveHdOSPRayMesh(this);
+    ospRenderParam->RemoveMaterialBinding(this);
+
+    // release the OSPRay objects, the world still referencing them keeps
+    // them alive until it is replaced
+    ospRenderParam->RetireResource(std::move(_sharedArrays));
+    _ospInstances.clear();
+    _instanceClusters.clear();
+    _group = nullptr;
+    delete _geometricModel;
+    _geometricModel = nullptr;
+    _ospMesh = nullptr;
+    _populated = false;
 }
 
 HdDirtyBits
@@ -196,6 +213,10 @@ HdOSPRayMesh::_PopulateOSPMesh(HdSceneDelegate* sceneDelegate,
 
     SdfPath const& id = GetId();
     bool isTransformDirty = false;
+    // edits that only move the prim, as opposed to changing what it is
+    bool animated = false;
+    bool modelChanged = false;
+    bool groupDirty = false;
 
     if (HdChangeTracker::IsPrimvarDirty(*dirtyBits, id, HdTokens->points)) {
         VtValue value = sceneDelegate->Get(id, HdTokens->points);
@@ -203,6 +224,9 @@ HdOSPRayMesh::_PopulateOSPMesh(HdSceneDelegate* sceneDelegate,
         if (_points.size() > 0) {
             _normalsValid = false;
         }
+        _bounds = GfRange3f();
+        for (const auto& point : _points)
+            _bounds.UnionWith(point);
     }
 
     if (HdChangeTracker::IsDisplayStyleDirty(*dirtyBits, id)) {
@@ -217,7 +241,7 @@ HdOSPRayMesh::_PopulateOSPMesh(HdSceneDelegate* sceneDelegate,
 
     if (HdChangeTracker::IsVisibilityDirty(*dirtyBits, id)) {
         _UpdateVisibility(sceneDelegate, dirtyBits);
-        renderParam->UpdateModelVersion();
+        modelChanged = true;
     }
 
     if (HdChangeTracker::IsCullStyleDirty(*dirtyBits, id)) {
@@ -236,6 +260,8 @@ HdOSPRayMesh::_PopulateOSPMesh(HdSceneDelegate* sceneDelegate,
         || HdChangeTracker::IsPrimvarDirty(*dirtyBits, id,
                                            HdOSPRayTokens->st)) {
         _UpdatePrimvarSources(sceneDelegate, *dirtyBits);
+        _buildOverrides
+               = HdOSPRayBuildQuality::ReadOverrides(sceneDelegate, id);
     }
 
     // do not subd wireframes
@@ -314,6 +340,7 @@ HdOSPRayMesh::_PopulateOSPMesh(HdSceneDelegate* sceneDelegate,
                                            HdOSPRayTokens->st)) {
 
         if (!_refined) {
+            _useQuads = useQuads;
             if (useQuads) {
                 _meshUtil->ComputeQuadIndices(&_quadIndices,
                                               &_quadPrimitiveParams);
@@ -345,6 +372,10 @@ HdOSPRayMesh::_PopulateOSPMesh(HdSceneDelegate* sceneDelegate,
             _ospMesh = _CreateOSPRayMesh(_computedTexcoords, _points,
                                          _computedNormals, _computedColors,
                                          _refined, useQuads);
+        } else if (!newMesh) {
+            // the subdivision mesh may be part of a world, a new one shares
+            // the new points
+            _ospMesh = _CreateOSPRaySubdivMesh();
         }
 
         if (!_normals.empty()) {
@@ -391,53 +422,29 @@ HdOSPRayMesh::_PopulateOSPMesh(HdSceneDelegate* sceneDelegate,
             }
         }
 
-        _ospMesh.commit();
-
-        const HdOSPRayMaterial* subsetMaterial = nullptr;
-
-        for (auto subset : _topology.GetGeomSubsets()) {
-            if (!TF_VERIFY(subset.type == HdGeomSubset::TypeFaceSet))
-                continue;
-
-            const HdOSPRayMaterial* material
-                   = static_cast<const HdOSPRayMaterial*>(renderIndex.GetSprim(
-                          HdPrimTypeTokens->material, subset.materialId));
-            subsetMaterial = material;
-        }
-
-        const HdOSPRayMaterial* material = nullptr;
-        if (subsetMaterial)
-            material = subsetMaterial;
-        else
-            material
-                   = static_cast<const HdOSPRayMaterial*>(renderIndex.GetSprim(
-                          HdPrimTypeTokens->material, GetMaterialId()));
-
-        opp::Material ospMaterial;
-
-        if (material && material->GetOSPRayMaterial()) {
-            ospMaterial = material->GetOSPRayMaterial();
-        } else {
-            ospMaterial = HdOSPRayMaterial::CreateDefaultMaterial(_singleColor);
-        }
+        // committed with the model in CommitResources
+        renderParam->GetCommitQueue().Enqueue(_ospMesh);
+
+        // the arrays of the previous geometry stay alive as long as worlds
+        // may render it
+        renderParam->RetireResource(std::move(_sharedArrays));
+        _sharedArrays = std::make_shared<_SharedArrays>();
+        _sharedArrays->points = _points;
+        _sharedArrays->normals = _normals;
+        _sharedArrays->colors = _colors;
+        _sharedArrays->texcoords = _texcoords;
+        _sharedArrays->triangulatedIndices = _triangulatedIndices;
+        _sharedArrays->quadIndices = _quadIndices;
+        _sharedArrays->faceVertexCounts = _topology.GetFaceVertexCounts();
+        _sharedArrays->faceVertexIndices = _topology.GetFaceVertexIndices();
 
         // Create OSPRay Mesh
         if (_geometricModel)
             delete _geometricModel;
         _geometricModel = new opp::GeometricModel(_ospMesh);
 
-        _geometricModel->setParam("material", ospMaterial);
+        _UpdateMaterial(renderIndex, renderParam);
         _geometricModel->setParam("id", (unsigned int)GetPrimId());
-        _ospMesh.commit();
-        if (_colorsInterpolation == HdInterpolationUniform
-            && !_computedColors.empty()) {
-            std::vector<vec4f> colors(_computedColors.size());
-            for (int i = 0; i < _computedColors.size(); i++) {
-                const auto& c = _computedColors[i];
-                colors[i] = vec4f(c[0], c[1], c[2], 1.f);
-            }
-            _geometricModel->setParam("color", opp::CopiedData(colors));
-        }
         if (_colorsInterpolation == HdInterpolationConstant
             && !_computedColors.empty()) {
             _geometricModel->setParam(
@@ -445,9 +452,19 @@ HdOSPRayMesh::_PopulateOSPMesh(HdSceneDelegate* sceneDelegate,
                    vec4f(_colors[0][0], _colors[0][1], _colors[0][2], 1.f));
         }
 
-        _geometricModel->commit();
+        renderParam->GetCommitQueue().Enqueue(*_geometricModel);
+        groupDirty = true;
 
-        renderParam->UpdateModelVersion();
+        if (newMesh)
+            modelChanged = true;
+        else
+            animated = true;
+    } else if ((*dirtyBits & HdChangeTracker::DirtyMaterialId)
+               && _geometricModel) {
+        // rebinding keeps the geometry, the model is only re-pointed
+        _UpdateMaterial(renderIndex, renderParam);
+        renderParam->GetCommitQueue().Enqueue(*_geometricModel);
+        renderParam->UpdateMaterialVersion();
     }
 
 #if HD_API_VERSION < 36
@@ -457,60 +474,55 @@ HdOSPRayMesh::_PopulateOSPMesh(HdSceneDelegate* sceneDelegate,
                                           GetInstancerId());
 #endif
 
-    if (HdChangeTracker::IsInstancerDirty(*dirtyBits, id) || isTransformDirty) {
-        _ospInstances.clear();
+    const bool instancesDirty
+           = HdChangeTracker::IsInstancerDirty(*dirtyBits, id)
+           || isTransformDirty;
+    // only points changes rebuild the BVH of the group, moving instances
+    // rebuilds the world
+    const bool deformed = animated;
+    animated |= instancesDirty;
+
+    // Moving a static prim turns it dynamic, which changes the static part
+    // of the scene.  Further animation of a dynamic prim leaves it intact.
+    const int syncFrame = renderParam->GetSyncFrame();
+    if (animated && _populated) {
+        if (!IsDynamic(syncFrame))
+            modelChanged = true;
+        _lastAnimatedSync = syncFrame;
+        if (deformed)
+            _lastDeformedSync = syncFrame;
+    } else if (animated) {
+        modelChanged = true;
+    }
+
+    if (instancesDirty) {
         if (!GetInstancerId().IsEmpty()) {
             HdRenderIndex& renderIndex = sceneDelegate->GetRenderIndex();
             HdInstancer* instancer = renderIndex.GetInstancer(GetInstancerId());
-            VtMatrix4dArray transforms
-                   = static_cast<HdOSPRayInstancer*>(instancer)
-                            ->ComputeInstanceTransforms(GetId());
-
-            size_t newSize = transforms.size();
-
-            opp::Group group;
-            group.setParam("geometry", opp::CopiedData(*_geometricModel));
-            group.commit();
-
-            _ospInstances.reserve(newSize);
-            for (size_t i = 0; i < newSize; i++) {
-                opp::Instance instance(group);
-
-                GfMatrix4f matf = _transform * GfMatrix4f(transforms[i]);
-                float* xfmf = matf.GetArray();
-                affine3f xfm(vec3f(xfmf[0], xfmf[1], xfmf[2]),
-                             vec3f(xfmf[4], xfmf[5], xfmf[6]),
-                             vec3f(xfmf[8], xfmf[9], xfmf[10]),
-                             vec3f(xfmf[12], xfmf[13], xfmf[14]));
-                instance.setParam("xfm", xfm);
-                instance.setParam("id", (unsigned int)i);
-                instance.commit();
-                _ospInstances.push_back(instance);
-            }
+            _instanceTransforms = static_cast<HdOSPRayInstancer*>(instancer)
+                                         ->ComputeInstanceTransforms(GetId());
         } else {
-            opp::Group group;
-            opp::Instance instance(group);
-            GfMatrix4f matf = _transform;
-            float* xfmf = matf.GetArray();
-            affine3f xfm(vec3f(xfmf[0], xfmf[1], xfmf[2]),
-                         vec3f(xfmf[4], xfmf[5], xfmf[6]),
-                         vec3f(xfmf[8], xfmf[9], xfmf[10]),
-                         vec3f(xfmf[12], xfmf[13], xfmf[14]));
-            instance.setParam("xfm", xfm);
-            instance.setParam("id", (unsigned int)0);
-            instance.commit();
-
-            if (_geomSubsetModels.size()) {
-                group.setParam("geometry", opp::CopiedData(_geomSubsetModels));
-            } else {
-                group.setParam("geometry", opp::CopiedData(*_geometricModel));
-            }
-
-            group.commit();
-            _ospInstances.push_back(instance);
+            _instanceTransforms = VtMatrix4dArray(1, GfMatrix4d(1.0));
         }
-        renderParam->UpdateModelVersion();
     }
+
+    // Worlds reference the current group and instances, changes create new
+    // ones.  The new instances replace the ones of a static mesh in the
+    // cached static instances of the render pass.
+    groupDirty |= _UpdateBuildQuality(syncFrame);
+    if (groupDirty)
+        _CreateGroup(renderParam->GetCommitQueue());
+    if (groupDirty || instancesDirty) {
+        _CreateInstances(renderParam->GetCommitQueue());
+        if (!IsDynamic(syncFrame))
+            modelChanged = true;
+    }
+
+    if (modelChanged)
+        renderParam->UpdateModelVersion();
+    else if (animated || groupDirty)
+        renderParam->UpdateDynamicModelVersion();
+
     if (!_populated) {
         renderParam->AddHdOSPRayMesh(this);
         _populated = true;
@@ -520,14 +532,180 @@ HdOSPRayMesh::_PopulateOSPMesh(HdSceneDelegate* sceneDelegate,
 }
 
 void
-HdOSPRayMesh::AddOSPInstances(std::vector<opp::Instance>& instanceList) const
+HdOSPRayMesh::_UpdateMaterial(HdRenderIndex const& renderIndex,
+                              HdOSPRayRenderParam* renderParam)
+{
+    // slot 0 holds the material of the mesh, further slots the materials of
+    // its geometry subsets, assigned to the coarse faces of the subsets
+    HdOSPRayMaterialBinding binding;
+    binding.materialIds.push_back(GetMaterialId());
+    std::vector<unsigned char> faceSlots;
+    for (auto const& subset : _topology.GetGeomSubsets()) {
+        if (!TF_VERIFY(subset.type == HdGeomSubset::TypeFaceSet))
+            continue;
+        auto slotId = std::find(binding.materialIds.begin(),
+                                binding.materialIds.end(), subset.materialId);
+        const size_t slot = slotId - binding.materialIds.begin();
+        if (slotId == binding.materialIds.end()) {
+            // slots are indexed with 8 bits
+            if (slot > 255) {
+                TF_WARN("%s: more than 256 subset materials",
+                        GetId().GetText());
+                continue;
+            }
+            binding.materialIds.push_back(subset.materialId);
+        }
+        if (slot == 0)
+            continue;
+        if (faceSlots.empty())
+            faceSlots.resize(_topology.GetNumFaces(), 0);
+        for (int face : subset.indices) {
+            if (face >= 0 && face < int(faceSlots.size()))
+                faceSlots[face] = (unsigned char)slot;
+        }
+    }
+
+    for (SdfPath const& materialId : binding.materialIds) {
+        const HdOSPRayMaterial* material
+               = static_cast<const HdOSPRayMaterial*>(renderIndex.GetSprim(
+                      HdPrimTypeTokens->material, materialId));
+        if (material && material->GetOSPRayMaterial())
+            binding.materials.push_back(material->GetOSPRayMaterial());
+        else
+            binding.materials.push_back(
+                   renderParam->GetMaterialCache().GetDefaultMaterial(
+                          _singleColor));
+    }
+    binding.models.push_back(*_geometricModel);
+    binding.Apply();
+
+    // slot of each primitive, remapped from the coarse faces through the
+    // primitive params of the triangulation or quadrangulation.  Refined
+    // meshes keep the coarse faces as primitives.
+    std::vector<unsigned char> primitiveSlots;
+    if (!faceSlots.empty() && _refined) {
+        primitiveSlots = faceSlots;
+    } else if (!faceSlots.empty() && _useQuads) {
+        primitiveSlots.resize(_quadPrimitiveParams.size(), 0);
+        for (size_t i = 0; i < _quadPrimitiveParams.size(); i++) {
+#if HD_API_VERSION < 36
+            const int param = _quadPrimitiveParams[i][0];
+#else
+            const int param = _quadPrimitiveParams[i];
+#endif
+            const int face
+                   = HdMeshUtil::DecodeFaceIndexFromCoarseFaceParam(param);
+            if (face < int(faceSlots.size()))
+                primitiveSlots[i] = faceSlots[face];
+        }
+    } else if (!faceSlots.empty()) {
+        primitiveSlots.resize(_trianglePrimitiveParams.size(), 0);
+        for (size_t i = 0; i < _trianglePrimitiveParams.size(); i++) {
+            const int face = HdMeshUtil::DecodeFaceIndexFromCoarseFaceParam(
+                   _trianglePrimitiveParams[i]);
+            if (face < int(faceSlots.size()))
+                primitiveSlots[i] = faceSlots[face];
+        }
+    }
+    if (!primitiveSlots.empty())
+        _geometricModel->setParam("index", opp::CopiedData(primitiveSlots));
+    else
+        _geometricModel->removeParam("index");
+
+    // the index array would also select among per primitive colors, which
+    // are dropped in favor of the subset materials
+    if (_colorsInterpolation == HdInterpolationUniform
+        && !_computedColors.empty()) {
+        if (primitiveSlots.empty()) {
+            std::vector<vec4f> colors(_computedColors.size());
+            for (int i = 0; i < _computedColors.size(); i++) {
+                const auto& c = _computedColors[i];
+                colors[i] = vec4f(c[0], c[1], c[2], 1.f);
+            }
+            _geometricModel->setParam("color", opp::CopiedData(colors));
+        } else {
+            _geometricModel->removeParam("color");
+        }
+    }
+
+    // the model is re-pointed when a material object is replaced, also if
+    // the material does not exist yet
+    renderParam->SetMaterialBinding(this, binding);
+}
+
+void
+HdOSPRayMesh::AddOSPInstances(std::vector<opp::Instance>& instanceList,
+                              HdOSPRayInstanceCuller const* culler) const
 {
     if (IsVisible()) {
-        instanceList.insert(instanceList.end(), _ospInstances.begin(),
-                            _ospInstances.end());
+        HdOSPRayInstancer::AddCulledOSPInstances(
+               _ospInstances, _instanceClusters, culler, instanceList);
     }
 }
 
+void
+HdOSPRayMesh::CullOSPInstances(HdOSPRayInstanceCuller const* culler,
+                               std::vector<bool>& visible) const
+{
+    if (IsVisible()) {
+        HdOSPRayInstancer::CullInstanceClusters(_instanceClusters, culler,
+                                                visible);
+    }
+}
+
+bool
+HdOSPRayMesh::IsDynamic(int syncFrame) const
+{
+    const int window = HdOSPRayConfig::GetInstance().dynamicSyncWindow;
+    return _lastAnimatedSync >= 0 && syncFrame - _lastAnimatedSync < window;
+}
+
+void
+HdOSPRayMesh::UpdateBuildQuality(int syncFrame)
+{
+    if (!_UpdateBuildQuality(syncFrame))
+        return;
+    // called by the render pass after CommitResources, so the new objects
+    // are committed right away
+    HdOSPRayCommitQueue commitQueue;
+    _CreateGroup(commitQueue);
+    _CreateInstances(commitQueue);
+    commitQueue.Commit();
+}
+
+bool
+HdOSPRayMesh::_UpdateBuildQuality(int syncFrame)
+{
+    const int window = HdOSPRayConfig::GetInstance().dynamicSyncWindow;
+    const bool deforming = _lastDeformedSync >= 0
+           && syncFrame - _lastDeformedSync < window;
+    const HdOSPRayBuildQuality quality = HdOSPRayBuildQuality::Compute(
+           deforming, _points.size(), _buildOverrides);
+    if (quality == _buildQuality)
+        return false;
+    _buildQuality = quality;
+    return true;
+}
+
+void
+HdOSPRayMesh::_CreateGroup(HdOSPRayCommitQueue& commitQueue)
+{
+    _group = opp::Group();
+    if (_geometricModel)
+        _group.setParam("geometry", opp::CopiedData(*_geometricModel));
+    _buildQuality.Apply(_group);
+    commitQueue.Enqueue(_group);
+}
+
+void
+HdOSPRayMesh::_CreateInstances(HdOSPRayCommitQueue& commitQueue)
+{
+    HdOSPRayInstancer::CreateOSPInstances(_group, _transform,
+                                          _instanceTransforms, _bounds,
+                                          _ospInstances, _instanceClusters);
+    commitQueue.Enqueue(_ospInstances);
+}
+
 void
 HdOSPRayMesh::_UpdateDrawItemGeometricShader(HdSceneDelegate* sceneDelegate,
                                              HdStDrawItem* drawItem,
@@ -601,7 +779,7 @@ HdOSPRayMesh::_CreateOSPRaySubdivMesh()
     int numVertices = _points.size();
 
     opp::SharedData vertices
-           = opp::SharedData(_points.data(), OSP_VEC3F, numVertices);
+           = opp::SharedData(_points.cdata(), OSP_VEC3F, numVertices);
     vertices.commit();
     mesh.setParam("vertex.position", vertices);
     if (numFaceVertices > 0) {
@@ -4,6 +4,7 @@
 #pragma once
 
 #include <pxr/base/gf/matrix4f.h>
+#include <pxr/base/gf/range3f.h>
 #include <pxr/base/gf/vec2f.h>
 #include <pxr/base/gf/vec3f.h>
 #include <pxr/base/gf/vec4f.h>
@@ -19,6 +20,10 @@
 #include <ospray/ospray_cpp.h>
 #include <ospray/ospray_cpp/ext/rkcommon.h>
 
+#include "instancer.h"
+#include "renderDelegate.h"
+
+#include <memory>
 #include <mutex>
 
 namespace opp = ospray::cpp;
@@ -26,6 +31,7 @@ namespace opp = ospray::cpp;
 PXR_NAMESPACE_USING_DIRECTIVE
 
 class HdStDrawItem;
+class HdOSPRayCommitQueue;
 class HdOSPRayRenderParam;
 
 /// \class HdOSPRayMesh
@@ -55,7 +61,23 @@ public:
 
     /// Add generated instances from sync function to the instanceList for
     /// rendering
-    void AddOSPInstances(std::vector<opp::Instance>& instanceList) const;
+    ///   \param culler if set, only instance clusters it keeps are added
+    void AddOSPInstances(std::vector<opp::Instance>& instanceList,
+                         HdOSPRayInstanceCuller const* culler
+                         = nullptr) const;
+
+    /// Appends whether \p culler keeps each instance cluster to \p visible,
+    /// nothing if the mesh is hidden
+    void CullOSPInstances(HdOSPRayInstanceCuller const* culler,
+                          std::vector<bool>& visible) const;
+
+    /// Whether the transform or points of the mesh changed within the last
+    /// HdOSPRayConfig::dynamicSyncWindow syncs
+    bool IsDynamic(int syncFrame) const;
+
+    /// Rebuilds the BVH of the mesh in a new group if its build quality
+    /// changed, e.g. once its points stopped changing
+    void UpdateBuildQuality(int syncFrame);
 
 protected:
     bool _UseQuadIndices(const HdRenderIndex& renderIndex,
@@ -81,6 +103,22 @@ private:
     void _UpdatePrimvarSources(HdSceneDelegate* sceneDelegate,
                                HdDirtyBits dirtyBits);
 
+    // Updates _buildQuality, returns true if it changed
+    bool _UpdateBuildQuality(int syncFrame);
+
+    // Replaces _group by a new group of _geometricModel.  Worlds may still
+    // reference the previous group, so it is never modified.
+    void _CreateGroup(HdOSPRayCommitQueue& commitQueue);
+
+    // Replaces _ospInstances by new instances of _group
+    void _CreateInstances(HdOSPRayCommitQueue& commitQueue);
+
+    // Sets the bound materials on _geometricModel, with a per primitive
+    // material index if geometry subsets bind further materials.  The model
+    // still needs to be committed.  Registers the binding with renderParam.
+    void _UpdateMaterial(HdRenderIndex const& renderIndex,
+                         HdOSPRayRenderParam* renderParam);
+
     opp::Geometry _CreateOSPRaySubdivMesh();
     opp::Geometry _CreateOSPRayMesh(const VtVec2fArray& texcoords,
                                     const VtVec3fArray& points,
@@ -163,18 +201,48 @@ private:
     }
 
     bool _populated { false };
+    // sync frame of the last transform or points change, -1 if none
+    int _lastAnimatedSync { -1 };
+    // sync frame of the last points change, -1 if none
+    int _lastDeformedSync { -1 };
 
     opp::Geometry _ospMesh;
     opp::GeometricModel* _geometricModel;
-    std::vector<opp::GeometricModel> _geomSubsetModels;
+    // arrays shared with _ospMesh, retired to the render param once the
+    // geometry is replaced, as worlds may still render it
+    struct _SharedArrays {
+        VtVec3fArray points;
+        VtVec3fArray normals;
+        VtVec3fArray colors;
+        VtVec2fArray texcoords;
+        VtVec3iArray triangulatedIndices;
+#if HD_API_VERSION < 44
+        VtVec4iArray quadIndices;
+#else
+        VtIntArray quadIndices;
+#endif
+        VtIntArray faceVertexCounts;
+        VtIntArray faceVertexIndices;
+    };
+    std::shared_ptr<_SharedArrays> _sharedArrays;
+    // group shared by all entries of _ospInstances
+    opp::Group _group;
+    HdOSPRayBuildQuality _buildQuality;
+    HdOSPRayBuildQuality::Overrides _buildOverrides;
     // Each instance of the mesh in the top-level scene is stored in
     // _ospInstances. This gets queried by the renderpass.
     std::vector<opp::Instance> _ospInstances;
+    // instancer transforms of _ospInstances, a single identity if the mesh
+    // is not instanced
+    VtMatrix4dArray _instanceTransforms;
+    // spatial clusters over _ospInstances, if instance clustering is enabled
+    std::vector<HdOSPRayInstanceCluster> _instanceClusters;
 
     HdMeshUtil* _meshUtil { nullptr };
     HdMeshTopology _topology;
     GfMatrix4f _transform;
     VtVec3fArray _points;
+    GfRange3f _bounds; // object space bounds of _points
     VtVec2fArray _texcoords;
     VtVec2fArray _computedTexcoords; // triangulated
     VtVec3fArray _normals;
@@ -209,6 +277,8 @@ private:
 
     // Draw styles.
     bool _refined;
+    // whether _quadIndices or _triangulatedIndices were computed last
+    bool _useQuads { false };
     bool _smoothNormals { false };
     bool _doubleSided { false };
     HdCullStyle _cullStyle;
@@ -10,7 +10,9 @@
 #include "renderParam.h"
 #include "renderPass.h"
 
+#include <pxr/imaging/hd/renderIndex.h>
 #include <pxr/imaging/hd/resourceRegistry.h>
+#include <pxr/imaging/hd/sceneDelegate.h>
 
 #include "basisCurves.h"
 #include "lights/cylinderLight.h"
@@ -186,6 +188,34 @@ HdOSPRayRenderDelegate::_Initialize()
     _settingDescriptors.push_back(
            { "tmp_acesColor", HdOSPRayRenderSettingsTokens->tmp_acesColor,
              VtValue(bool(HdOSPRayConfig::GetInstance().tmp_acesColor)) });
+    _settingDescriptors.push_back(
+           { "previewMaterials",
+             HdOSPRayRenderSettingsTokens->previewMaterials,
+             VtValue(bool(HdOSPRayConfig::GetInstance().previewMaterials)) });
+    _settingDescriptors.push_back(
+           { "instanceCulling", HdOSPRayRenderSettingsTokens->instanceCulling,
+             VtValue(bool(HdOSPRayConfig::GetInstance().instanceCulling)) });
+    _settingDescriptors.push_back(
+           { "cullingFrustumMargin",
+             HdOSPRayRenderSettingsTokens->cullingFrustumMargin,
+             VtValue(float(
+                    HdOSPRayConfig::GetInstance().cullingFrustumMargin)) });
+    _settingDescriptors.push_back(
+           { "cullingMaxDistance",
+             HdOSPRayRenderSettingsTokens->cullingMaxDistance,
+             VtValue(float(
+                    HdOSPRayConfig::GetInstance().cullingMaxDistance)) });
+    _settingDescriptors.push_back(
+           { "cullingMinSize", HdOSPRayRenderSettingsTokens->cullingMinSize,
+             VtValue(float(HdOSPRayConfig::GetInstance().cullingMinSize)) });
+    _settingDescriptors.push_back(
+           { "lightClustering", HdOSPRayRenderSettingsTokens->lightClustering,
+             VtValue(bool(HdOSPRayConfig::GetInstance().lightClustering)) });
+    _settingDescriptors.push_back(
+           { "lightClusterThreshold",
+             HdOSPRayRenderSettingsTokens->lightClusterThreshold,
+             VtValue(float(
+                    HdOSPRayConfig::GetInstance().lightClusterThreshold)) });
     _PopulateDefaultSettings(_settingDescriptors);
 }
 
@@ -214,6 +244,12 @@ HdOSPRayRenderDelegate::CommitResources(HdChangeTracker* tracker)
     if (modelVersion > _lastCommittedModelVersion) {
         _lastCommittedModelVersion = modelVersion;
     }
+    // commit the OSPRay objects of all synced prims, so that the BVH
+    // builds of independent groups run concurrently and finish before the
+    // render pass commits the world
+    if (!rp->GetCommitQueue().IsEmpty())
+        rp->GetCommitQueue().Commit();
+    rp->AdvanceSyncFrame();
 }
 
 #if HD_API_VERSION < 41
@@ -289,6 +325,7 @@ HdRenderPassSharedPtr
 HdOSPRayRenderDelegate::CreateRenderPass(HdRenderIndex* index,
                                          HdRprimCollection const& collection)
 {
+    _renderIndex = index;
     return HdRenderPassSharedPtr(
            new HdOSPRayRenderPass(index, collection, _renderer, _renderParam));
 }
@@ -423,3 +460,98 @@ HdOSPRayRenderDelegate::GetRenderSettingDescriptors() const
 {
     return _settingDescriptors;
 }
+
+void
+HdOSPRayRenderDelegate::SetRenderSetting(TfToken const& key,
+                                         VtValue const& value)
+{
+    VtValue previous = GetRenderSetting(key);
+    if (key == HdOSPRayRenderSettingsTokens->previewMaterials
+        && previous.IsEmpty())
+        previous = VtValue(HdOSPRayConfig::GetInstance().previewMaterials);
+    HdRenderDelegate::SetRenderSetting(key, value);
+
+    // materials pick up their fidelity when synced.  Before the first
+    // render pass exists no material has been synced yet.
+    if (key == HdOSPRayRenderSettingsTokens->previewMaterials
+        && value != previous && _renderIndex) {
+        HdChangeTracker& changeTracker = _renderIndex->GetChangeTracker();
+        for (SdfPath const& id : _renderIndex->GetSprimSubtree(
+                    HdPrimTypeTokens->material, SdfPath::AbsoluteRootPath()))
+            changeTracker.MarkSprimDirty(id, HdMaterial::DirtyResource);
+    }
+}
+
+// clang-format off
+TF_DEFINE_PRIVATE_TOKENS(
+    _tokens,
+    ((dynamicScene, "ospray:dynamicScene"))
+    ((compactMode, "ospray:compactMode"))
+    ((robustMode, "ospray:robustMode"))
+);
+// clang-format on
+
+static int
+_ReadBoolPrimvar(HdSceneDelegate* sceneDelegate, SdfPath const& id,
+                 TfToken const& name)
+{
+    const VtValue value = sceneDelegate->Get(id, name);
+    if (value.IsHolding<bool>())
+        return value.UncheckedGet<bool>();
+    if (value.IsHolding<int>())
+        return value.UncheckedGet<int>() != 0;
+    return -1;
+}
+
+HdOSPRayBuildQuality::Overrides
+HdOSPRayBuildQuality::ReadOverrides(HdSceneDelegate* sceneDelegate,
+                                    SdfPath const& id)
+{
+    Overrides overrides;
+    overrides.dynamicScene
+           = _ReadBoolPrimvar(sceneDelegate, id, _tokens->dynamicScene);
+    overrides.compactMode
+           = _ReadBoolPrimvar(sceneDelegate, id, _tokens->compactMode);
+    overrides.robustMode
+           = _ReadBoolPrimvar(sceneDelegate, id, _tokens->robustMode);
+    return overrides;
+}
+
+HdOSPRayBuildQuality
+HdOSPRayBuildQuality::Compute(bool dynamic, size_t numVertices,
+                              Overrides const& overrides)
+{
+    const HdOSPRayConfig& config = HdOSPRayConfig::GetInstance();
+    HdOSPRayBuildQuality quality;
+    quality.dynamicScene = dynamic;
+    quality.compactMode = config.compactModeThreshold > 0
+           && numVertices >= config.compactModeThreshold;
+    quality.robustMode = false;
+
+    if (overrides.dynamicScene >= 0)
+        quality.dynamicScene = overrides.dynamicScene;
+    if (overrides.compactMode >= 0)
+        quality.compactMode = overrides.compactMode;
+    if (overrides.robustMode >= 0)
+        quality.robustMode = overrides.robustMode;
+    return quality;
+}
+
+HdOSPRayBuildQuality
+HdOSPRayBuildQuality::ComputeWorld(bool dynamic, size_t numInstances)
+{
+    const unsigned int threshold
+           = HdOSPRayConfig::GetInstance().worldCompactModeThreshold;
+    HdOSPRayBuildQuality quality;
+    quality.dynamicScene = dynamic;
+    quality.compactMode = threshold > 0 && numInstances >= threshold;
+    return quality;
+}
+
+void
+HdOSPRayBuildQuality::Apply(opp::Group& group) const
+{
+    group.setParam("dynamicScene", dynamicScene);
+    group.setParam("compactMode", compactMode);
+    group.setParam("robustMode", robustMode);
+}
@@ -26,7 +26,9 @@ PXR_NAMESPACE_USING_DIRECTIVE
            staticDirectionalLights)(minContribution)(maxContribution)(         \
            interactiveTargetFPS)(useTextureGammaCorrection)(tmp_exposure)(     \
            tmp_enabled)(tmp_contrast)(tmp_shoulder)(tmp_midIn)(tmp_midOut)(    \
-           tmp_hdrMax)(tmp_acesColor)
+           tmp_hdrMax)(tmp_acesColor)(instanceCulling)(cullingFrustumMargin)(  \
+           cullingMaxDistance)(cullingMinSize)(previewMaterials)(              \
+           lightClustering)(lightClusterThreshold)
 
 TF_DECLARE_PUBLIC_TOKENS(HdOSPRayRenderSettingsTokens,
                          HDOSPRAY_RENDER_SETTINGS_TOKENS);
@@ -35,6 +37,61 @@ TF_DECLARE_PUBLIC_TOKENS(HdOSPRayRenderSettingsTokens,
 
 TF_DECLARE_PUBLIC_TOKENS(HdOSPRayTokens, HDOSPRAY_API, HDOSPRAY_TOKENS);
 
+/// \struct HdOSPRayBuildQuality
+///
+/// BVH build flags of the group shared by the instances of a prim, or of the
+/// world.  Prims whose points changed in recent syncs get fast dynamic
+/// builds, static prims get high quality builds and large prims are built in
+/// compact mode.  Each flag can be forced per prim with a constant bool
+/// primvar "ospray:dynamicScene", "ospray:compactMode" or
+/// "ospray:robustMode".
+///
+struct HdOSPRayBuildQuality {
+    bool dynamicScene { false };
+    bool compactMode { false };
+    bool robustMode { false };
+
+    /// per prim primvar overrides, -1 if not authored
+    struct Overrides {
+        int dynamicScene { -1 };
+        int compactMode { -1 };
+        int robustMode { -1 };
+    };
+
+    /// reads the overrides of prim \p id from its primvars
+    static Overrides ReadOverrides(HdSceneDelegate* sceneDelegate,
+                                  SdfPath const& id);
+
+    /// applies the build policy
+    ///   \param dynamic whether the points of the prim changed in recent
+    ///                  syncs
+    ///   \param numVertices vertex count of the prim geometry
+    ///   \param overrides per prim overrides
+    static HdOSPRayBuildQuality Compute(bool dynamic, size_t numVertices,
+                                        Overrides const& overrides);
+
+    /// applies the build policy of the world
+    ///   \param dynamic whether any instance moved in recent syncs
+    ///   \param numInstances instance count of the world
+    static HdOSPRayBuildQuality ComputeWorld(bool dynamic,
+                                             size_t numInstances);
+
+    /// sets the flags on \p group, which still needs to be committed
+    void Apply(opp::Group& group) const;
+
+    bool operator==(HdOSPRayBuildQuality const& other) const
+    {
+        return dynamicScene == other.dynamicScene
+               && compactMode == other.compactMode
+               && robustMode == other.robustMode;
+    }
+
+    bool operator!=(HdOSPRayBuildQuality const& other) const
+    {
+        return !(*this == other);
+    }
+};
+
 class HdOSPRayRenderParam;
 
 ///
@@ -228,6 +285,13 @@ public:
     virtual HdRenderSettingDescriptorList
     GetRenderSettingDescriptors() const override;
 
+    /// Sets a render setting.  Switching previewMaterials marks all
+    /// materials dirty, so the next sync updates their fidelity.
+    ///   \param key The render setting to set.
+    ///   \param value The new value.
+    virtual void SetRenderSetting(TfToken const& key,
+                                  VtValue const& value) override;
+
 private:
     static const TfTokenVector SUPPORTED_RPRIM_TYPES;
     static const TfTokenVector SUPPORTED_SPRIM_TYPES;
@@ -253,6 +317,10 @@ private:
 
     int _lastCommittedModelVersion { -1 };
 
+    // render index of the render passes, null until the first one is
+    // created
+    HdRenderIndex* _renderIndex { nullptr };
+
     // A shared HdOSPRayRenderParam object that stores top-level OSPRay state;
     // passed to prims during Sync().
     std::shared_ptr<HdOSPRayRenderParam> _renderParam;
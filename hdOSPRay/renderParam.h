@@ -3,20 +3,165 @@
 
 #pragma once
 
+#include <pxr/base/work/loops.h>
 #include <pxr/imaging/hd/renderDelegate.h>
 #include <pxr/pxr.h>
 
 #include "basisCurves.h"
 #include "lights/light.h"
+#include "material.h"
 #include "mesh.h"
+#include "texture.h"
 
 #include <ospray/ospray_cpp.h>
 #include <ospray/ospray_cpp/ext/rkcommon.h>
 
+#include <algorithm>
+#include <atomic>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <unordered_map>
+#include <vector>
+
 namespace opp = ospray::cpp;
 
 PXR_NAMESPACE_USING_DIRECTIVE
 
+///
+/// \class HdOSPRayPrimRegistry
+///
+/// Dense array of prims with constant time add and remove.  Removing a prim
+/// moves the last prim into its slot, so iterating the array only visits
+/// live prims.  Not thread safe.
+///
+template <class Prim>
+class HdOSPRayPrimRegistry {
+public:
+    void Add(Prim* prim)
+    {
+        if (_slots.emplace(prim, _prims.size()).second)
+            _prims.push_back(prim);
+    }
+
+    // returns false if prim was not registered
+    bool Remove(Prim* prim)
+    {
+        auto slot = _slots.find(prim);
+        if (slot == _slots.end())
+            return false;
+        Prim* last = _prims.back();
+        _prims[slot->second] = last;
+        _slots[last] = slot->second;
+        _prims.pop_back();
+        _slots.erase(prim);
+        return true;
+    }
+
+    bool Contains(const Prim* prim) const
+    {
+        return _slots.count(prim) > 0;
+    }
+
+    const std::vector<Prim*>& GetPrims() const
+    {
+        return _prims;
+    }
+
+private:
+    std::vector<Prim*> _prims;
+    // index of each prim in _prims
+    std::unordered_map<const Prim*, size_t> _slots;
+};
+
+///
+/// \class HdOSPRayCommitQueue
+///
+/// OSPRay objects set up by prim syncs, committed together once all prims
+/// synced.  Objects are committed in dependency order: geometries, the
+/// models referencing them, groups, which build their BVHs, and finally
+/// instances.  The objects of each stage are committed in parallel.
+///
+class HdOSPRayCommitQueue {
+public:
+    // thread safe
+    void Enqueue(opp::Geometry const& geometry)
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _geometries.push_back(geometry);
+    }
+
+    // thread safe
+    void Enqueue(opp::GeometricModel const& model)
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _models.push_back(model);
+    }
+
+    // thread safe
+    void Enqueue(opp::Group const& group)
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _groups.push_back(group);
+    }
+
+    // thread safe
+    void Enqueue(std::vector<opp::Instance> const& instances)
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _instances.insert(_instances.end(), instances.begin(),
+                          instances.end());
+    }
+
+    // thread safe
+    bool IsEmpty()
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return _geometries.empty() && _models.empty() && _groups.empty()
+               && _instances.empty();
+    }
+
+    // thread safe.  Commits and dequeues all enqueued objects.
+    void Commit()
+    {
+        std::vector<opp::Geometry> geometries;
+        std::vector<opp::GeometricModel> models;
+        std::vector<opp::Group> groups;
+        std::vector<opp::Instance> instances;
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            geometries.swap(_geometries);
+            models.swap(_models);
+            groups.swap(_groups);
+            instances.swap(_instances);
+        }
+        _CommitAll(geometries);
+        _CommitAll(models);
+        _CommitAll(groups);
+        _CommitAll(instances);
+    }
+
+private:
+    // OSPRay objects are independent, so they can be committed concurrently
+    template <class Object>
+    static void _CommitAll(std::vector<Object> const& objects)
+    {
+        WorkParallelForN(objects.size(),
+                         [&objects](size_t begin, size_t end) {
+                             for (size_t i = begin; i < end; i++)
+                                 objects[i].commit();
+                         });
+    }
+
+    std::mutex _mutex;
+    std::vector<opp::Geometry> _geometries;
+    std::vector<opp::GeometricModel> _models;
+    std::vector<opp::Group> _groups;
+    std::vector<opp::Instance> _instances;
+};
+
 ///
 /// \class HdOSPRayRenderParam
 ///
@@ -36,7 +181,36 @@ public:
         return _renderer;
     }
 
+    // thread safe.  Textures shared by all materials and lights.
+    HdOSPRayTextureCache& GetTextureCache()
+    {
+        return _textureCache;
+    }
+
+    // thread safe.  Interned materials shared by materials and prims.
+    HdOSPRayMaterialCache& GetMaterialCache()
+    {
+        return _materialCache;
+    }
+
+    // thread safe.  Geometries, models, groups and instances of synced
+    // prims, committed by the render delegate in CommitResources.
+    HdOSPRayCommitQueue& GetCommitQueue()
+    {
+        return _commitQueue;
+    }
+
+    /// Marks a change to the static part of the scene.  Conservatively used
+    /// for any edit that is not an animation update of a dynamic prim.
     void UpdateModelVersion()
+    {
+        _modelVersion++;
+        _staticModelVersion++;
+    }
+
+    /// Marks a change that only affects prims which are already dynamic,
+    /// so the cached static instances stay valid.
+    void UpdateDynamicModelVersion()
     {
         _modelVersion++;
     }
@@ -46,6 +220,23 @@ public:
         return _modelVersion.load();
     }
 
+    int GetStaticModelVersion()
+    {
+        return _staticModelVersion.load();
+    }
+
+    /// Advanced once per sync by the render delegate.  Prims use it to tell
+    /// whether they changed recently, see HDOSPRAY_DYNAMIC_SYNC_WINDOW.
+    void AdvanceSyncFrame()
+    {
+        _syncFrame++;
+    }
+
+    int GetSyncFrame()
+    {
+        return _syncFrame.load();
+    }
+
     void UpdateLightVersion()
     {
         _lightVersion++;
@@ -56,6 +247,58 @@ public:
         return _lightVersion.load();
     }
 
+    /// Marks a parameter change of a committed material.  Materials are
+    /// updated in place, so this only restarts accumulation.
+    void UpdateMaterialVersion()
+    {
+        _materialVersion++;
+    }
+
+    int GetMaterialVersion()
+    {
+        return _materialVersion.load();
+    }
+
+    // Serial of a new world, larger than the serials of all worlds created
+    // before.  Called by the renderPass.
+    int NextWorldSerial()
+    {
+        return ++_worldSerial;
+    }
+
+    // thread safe.  Keeps resource alive until every render pass renders a
+    // world created after this call.  Prims retire the arrays shared with
+    // OSPRay objects they replaced, which older worlds may still render.
+    void RetireResource(std::shared_ptr<void> resource)
+    {
+        if (!resource)
+            return;
+        std::lock_guard<std::mutex> lock(_retiredMutex);
+        _retiredResources.emplace_back(_worldSerial.load(),
+                                       std::move(resource));
+    }
+
+    // thread safe.  Called by a render pass once none of its frames is
+    // rendering, with the serial of the world it renders next.  Releases the
+    // resources retired before all render passes rendered newer worlds.
+    void ReleaseRetiredResources(const void* renderPass, int worldSerial)
+    {
+        std::lock_guard<std::mutex> lock(_retiredMutex);
+        _renderedWorldSerials[renderPass] = worldSerial;
+        for (auto const& rendered : _renderedWorldSerials)
+            worldSerial = std::min(worldSerial, rendered.second);
+        while (!_retiredResources.empty()
+               && _retiredResources.front().first < worldSerial)
+            _retiredResources.pop_front();
+    }
+
+    // thread safe.  Called when a render pass is destroyed.
+    void RemoveRenderPass(const void* renderPass)
+    {
+        std::lock_guard<std::mutex> lock(_retiredMutex);
+        _renderedWorldSerials.erase(renderPass);
+    }
+
     // thread safe.  Lights added to scene and released by renderPass.
     void AddHdOSPRayLight(const SdfPath& id, const HdOSPRayLight* hdOsprayLight)
     {
@@ -78,35 +321,127 @@ public:
         return _hdOSPRayLights;
     }
 
-    // thread safe.  Lights added to scene and released by renderPass.
-    void AddHdOSPRayMesh(const HdOSPRayMesh* hdOsprayMesh)
+    // thread safe.  Meshes added to scene once populated.
+    void AddHdOSPRayMesh(HdOSPRayMesh* hdOsprayMesh)
     {
-        std::lock_guard<std::mutex> lock(_ospMutex);
-        _hdOSPRayMeshes.push_back(hdOsprayMesh);
+        std::lock_guard<std::mutex> lock(_primMutex);
+        _hdOSPRayMeshes.Add(hdOsprayMesh);
         UpdateModelVersion();
     }
 
-    // thread safe.  Lights added to scene and released by renderPass.
-    void AddHdOSPRayBasisCurves(const HdOSPRayBasisCurves* hdOsprayBasisCurves)
+    // thread safe.  Called when the mesh is removed from the scene.
+    void RemoveHdOSPRayMesh(HdOSPRayMesh* hdOsprayMesh)
     {
-        std::lock_guard<std::mutex> lock(_ospMutex);
-        _hdOSPRayBasisCurves.push_back(hdOsprayBasisCurves);
+        std::lock_guard<std::mutex> lock(_primMutex);
+        if (_hdOSPRayMeshes.Remove(hdOsprayMesh))
+            UpdateModelVersion();
+    }
+
+    // thread safe.  Curves added to scene once populated.
+    void AddHdOSPRayBasisCurves(HdOSPRayBasisCurves* hdOsprayBasisCurves)
+    {
+        std::lock_guard<std::mutex> lock(_primMutex);
+        _hdOSPRayBasisCurves.Add(hdOsprayBasisCurves);
         UpdateModelVersion();
     }
 
+    // thread safe.  Called when the curves are removed from the scene.
+    void RemoveHdOSPRayBasisCurves(HdOSPRayBasisCurves* hdOsprayBasisCurves)
+    {
+        std::lock_guard<std::mutex> lock(_primMutex);
+        if (_hdOSPRayBasisCurves.Remove(hdOsprayBasisCurves))
+            UpdateModelVersion();
+    }
+
     // not thread safe
-    const std::vector<const HdOSPRayMesh*>& GetHdOSPRayMeshes()
+    const std::vector<HdOSPRayMesh*>& GetHdOSPRayMeshes()
     {
-        return _hdOSPRayMeshes;
+        return _hdOSPRayMeshes.GetPrims();
     }
 
     // not thread safe
-    const std::vector<const HdOSPRayBasisCurves*>& GetHdOSPRayBasisCurves()
+    const std::vector<HdOSPRayBasisCurves*>& GetHdOSPRayBasisCurves()
+    {
+        return _hdOSPRayBasisCurves.GetPrims();
+    }
+
+    // not thread safe.  Whether the mesh is still part of the scene.
+    bool HasHdOSPRayMesh(const HdOSPRayMesh* hdOsprayMesh)
+    {
+        return _hdOSPRayMeshes.Contains(hdOsprayMesh);
+    }
+
+    // not thread safe.  Whether the curves are still part of the scene.
+    bool HasHdOSPRayBasisCurves(const HdOSPRayBasisCurves* hdOsprayBasisCurves)
     {
-        return _hdOSPRayBasisCurves;
+        return _hdOSPRayBasisCurves.Contains(hdOsprayBasisCurves);
+    }
+
+    // thread safe.  Records the materials the geometric models of prim
+    // reference, replacing earlier bindings of prim.  Material syncs use the
+    // bindings to re-point models without rebuilding them.
+    void SetMaterialBinding(const void* prim,
+                            HdOSPRayMaterialBinding const& binding)
+    {
+        std::lock_guard<std::mutex> lock(_materialMutex);
+        _RemoveMaterialBinding(prim);
+        if (binding.models.empty())
+            return;
+        _materialBindings[prim] = binding;
+        for (SdfPath const& materialId : binding.materialIds) {
+            if (!materialId.IsEmpty())
+                _boundPrims[materialId].insert(prim);
+        }
+    }
+
+    // thread safe.  Called when prim is removed.
+    void RemoveMaterialBinding(const void* prim)
+    {
+        std::lock_guard<std::mutex> lock(_materialMutex);
+        _RemoveMaterialBinding(prim);
+    }
+
+    // thread safe.  Sets material on the geometric models bound to
+    // materialId and enqueues them to the commit queue.  Returns true if any
+    // model was updated.
+    bool UpdateMaterialBindings(SdfPath const& materialId,
+                                opp::Material material)
+    {
+        std::lock_guard<std::mutex> lock(_materialMutex);
+        auto prims = _boundPrims.find(materialId);
+        if (prims == _boundPrims.end())
+            return false;
+        for (const void* prim : prims->second) {
+            HdOSPRayMaterialBinding& binding = _materialBindings[prim];
+            for (size_t i = 0; i < binding.materialIds.size(); i++) {
+                if (binding.materialIds[i] == materialId)
+                    binding.materials[i] = material;
+            }
+            binding.Apply();
+            for (auto& model : binding.models)
+                _commitQueue.Enqueue(model);
+        }
+        return true;
     }
 
 private:
+    // not thread safe
+    void _RemoveMaterialBinding(const void* prim)
+    {
+        auto binding = _materialBindings.find(prim);
+        if (binding == _materialBindings.end())
+            return;
+        for (SdfPath const& materialId : binding->second.materialIds) {
+            auto prims = _boundPrims.find(materialId);
+            if (prims == _boundPrims.end())
+                continue;
+            prims->second.erase(prim);
+            if (prims->second.empty())
+                _boundPrims.erase(prims);
+        }
+        _materialBindings.erase(binding);
+    }
+
     // mutex over ospray calls to the global model and global instances. OSPRay
     // is not thread safe
     std::mutex _ospMutex;
@@ -115,11 +450,31 @@ private:
     std::unordered_map<SdfPath, const HdOSPRayLight*, SdfPath::Hash>
            _hdOSPRayLights;
 
-    std::vector<const HdOSPRayMesh*> _hdOSPRayMeshes;
-    std::vector<const HdOSPRayBasisCurves*> _hdOSPRayBasisCurves;
+    // populated prims, removed in their Finalize
+    std::mutex _primMutex;
+    HdOSPRayPrimRegistry<HdOSPRayMesh> _hdOSPRayMeshes;
+    HdOSPRayPrimRegistry<HdOSPRayBasisCurves> _hdOSPRayBasisCurves;
+
+    // material bindings of each prim, and the prims bound to each material
+    std::mutex _materialMutex;
+    std::map<const void*, HdOSPRayMaterialBinding> _materialBindings;
+    std::map<SdfPath, std::set<const void*>> _boundPrims;
 
     opp::Renderer _renderer;
+    HdOSPRayTextureCache _textureCache;
+    HdOSPRayMaterialCache _materialCache;
+    HdOSPRayCommitQueue _commitQueue;
+    // resources retired by prims, with the serial of the last world created
+    // when they were retired, and the serial of the world each render pass
+    // renders
+    std::atomic<int> _worldSerial { 0 };
+    std::mutex _retiredMutex;
+    std::deque<std::pair<int, std::shared_ptr<void>>> _retiredResources;
+    std::map<const void*, int> _renderedWorldSerials;
     /// A version counters for edits to scene (e.g., models or lights).
     std::atomic<int> _modelVersion { 1 };
     std::atomic<int> _lightVersion { 1 };
+    std::atomic<int> _materialVersion { 1 };
+    std::atomic<int> _staticModelVersion { 1 };
+    std::atomic<int> _syncFrame { 0 };
 };
\ No newline at end of file
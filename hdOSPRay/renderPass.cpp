@@ -7,13 +7,16 @@
 #include "camera.h"
 #include "config.h"
 #include "context.h"
+#include "instancer.h"
 #include "lights/domeLight.h"
 #include "lights/light.h"
 #include "mesh.h"
 #include "renderDelegate.h"
 
 #include <pxr/imaging/hd/camera.h>
+#include <pxr/imaging/hd/material.h>
 #include <pxr/imaging/hd/perfLog.h>
+#include <pxr/imaging/hd/renderIndex.h>
 #include <pxr/imaging/hd/renderPassState.h>
 
 #include <pxr/base/gf/vec2f.h>
@@ -21,6 +24,7 @@
 
 #include <ospray/ospray_util.h>
 
+#include <algorithm>
 #include <iostream>
 
 using namespace rkcommon::math;
@@ -79,6 +83,11 @@ HdOSPRayRenderPass::HdOSPRayRenderPass(
 
 HdOSPRayRenderPass::~HdOSPRayRenderPass()
 {
+    if (_currentFrame.isValid()) {
+        _currentFrame.osprayFrame.cancel();
+        _currentFrame.osprayFrame.wait();
+    }
+    _renderParam->RemoveRenderPass(this);
 }
 
 void
@@ -90,8 +99,10 @@ HdOSPRayRenderPass::ResetImage()
 bool
 HdOSPRayRenderPass::IsConverged() const
 {
-    return ((unsigned int)_numSamplesAccumulated
-            >= (unsigned int)_samplesToConvergence);
+    // keep executing until a pending world and all textures are swapped in
+    return !_pendingWorld && !_renderParam->GetTextureCache().HasPendingLoads()
+           && ((unsigned int)_numSamplesAccumulated
+               >= (unsigned int)_samplesToConvergence);
 }
 
 void
@@ -100,6 +111,7 @@ HdOSPRayRenderPass::_MarkCollectionDirty()
     // redraw on next execute
     _pendingResetImage = true;
     _pendingModelUpdate = true;
+    _collectionDirty = true;
 }
 
 static GfRect2i
@@ -219,28 +231,59 @@ HdOSPRayRenderPass::_Execute(HdRenderPassStateSharedPtr const& renderPassState,
            = renderPassState->GetProjectionMatrix().GetInverse();
     bool cameraDirty = (inverseViewMatrix != _inverseViewMatrix
                         || inverseProjMatrix != _inverseProjMatrix);
+    const bool cameraMoved = cameraDirty;
+
+    // asynchronously committed worlds reset the image once swapped in, the
+    // current image keeps accumulating until then
+    const bool asyncWorldCommit
+           = HdOSPRayConfig::GetInstance().asyncWorldCommit && _worldCommitted;
 
     // dirty scene mesh representation
     int currentModelVersion = _renderParam->GetModelVersion();
     if (_lastRenderedModelVersion != currentModelVersion) {
         _pendingModelUpdate = true;
         _lastRenderedModelVersion = currentModelVersion;
-        cameraDirty = true;
+        if (!asyncWorldCommit)
+            cameraDirty = true;
+    }
+
+    // prims are filtered by render tag when gathered.  Switching the render
+    // tags only assembles the cached instances of each tag.
+    const int renderTagVersion
+           = int(GetRenderIndex()->GetChangeTracker().GetRenderTagVersion());
+    if (_lastRenderTagVersion != renderTagVersion) {
+        _lastRenderTagVersion = renderTagVersion;
+        _collectionDirty = true;
+        _pendingModelUpdate = true;
+    }
+    if (_renderTags != renderTags) {
+        _renderTags = renderTags;
+        _renderTagsDirty = true;
+        _pendingModelUpdate = true;
     }
 
     // dirty lights
     int currentLightVersion = _renderParam->GetLightVersion();
     if (_lastRenderedLightVersion != currentLightVersion) {
         _pendingLightUpdate = true;
+        _lightClusterTreeDirty = true;
         _lastRenderedLightVersion = currentLightVersion;
         cameraDirty = true;
     }
 
+    // materials edited in place
+    int currentMaterialVersion = _renderParam->GetMaterialVersion();
+    if (_lastRenderedMaterialVersion != currentMaterialVersion) {
+        _lastRenderedMaterialVersion = currentMaterialVersion;
+        _pendingResetImage = true;
+    }
+
     // if we need to recommit the world
     bool worldDirty = _pendingModelUpdate;
     bool lightsDirty = _pendingLightUpdate;
 
-    _pendingResetImage |= (_pendingModelUpdate || _pendingLightUpdate);
+    if (!asyncWorldCommit)
+        _pendingResetImage |= (_pendingModelUpdate || _pendingLightUpdate);
     _pendingResetImage |= (frameBufferDirty || cameraDirty);
 
     const GfRect2i dataWindow = _GetDataWindow(renderPassState);
@@ -527,6 +570,8 @@ HdOSPRayRenderPass::_Execute(HdRenderPassStateSharedPtr const& renderPassState,
     if (cameraDirty) {
         _inverseViewMatrix = inverseViewMatrix;
         _inverseProjMatrix = inverseProjMatrix;
+        _worldToClipMatrix = renderPassState->GetWorldToViewMatrix()
+               * renderPassState->GetProjectionMatrix();
         if (_interactiveEnabled)
             _interacting = true;
         ProcessCamera(renderPassState);
@@ -561,19 +606,88 @@ HdOSPRayRenderPass::_Execute(HdRenderPassStateSharedPtr const& renderPassState,
         _currentFrameBufferScale = 1.0f;
     }
 
+    // cull instances while the camera moves and restore them over a few
+    // frames once it stops.  The world is only rebuilt if the visible
+    // instance clusters changed.
+    if (_instanceCulling && _interactiveEnabled) {
+        bool cullingStep = false;
+        if (cameraMoved) {
+            _cullingLevel = 0;
+            cullingStep = true;
+        } else if (_cullingLevel < HDOSPRAY_CULLING_RESTORE_STEPS) {
+            _cullingLevel++;
+            cullingStep = true;
+        }
+        if (cullingStep && _UpdateCulledClusters()) {
+            _pendingModelUpdate = true;
+            _pendingResetImage = true;
+        }
+        worldDirty |= _pendingModelUpdate;
+    }
+
+    // light clusters follow the camera while rendering interactively and
+    // are replaced by all lights once it stops.  The cluster lights are
+    // updated in place, the world is only rebuilt if lights enter or leave
+    // the cut individually or it needs more cluster lights.
+    if (_lightClustering && _interacting != _lightClustersActive)
+        _pendingLightUpdate = true;
+    else if (_lightClustersActive && cameraMoved && !_pendingLightUpdate
+             && _lightClusterTree.UpdateCut(
+                    GfVec3f(_inverseViewMatrix.Transform(GfVec3d(0.0))),
+                    _lightClusterThreshold)) {
+        if (_lightClusterTree.CommitCut())
+            _pendingLightUpdate = true;
+    }
+
+    // once animation stops, rebuild the world with settled prims moved
+    // into the static set.  The scene content is unchanged, so the
+    // accumulated image stays valid and accumulation continues across the
+    // rebuild.
+    bool settleOnly = false;
+    if (!_pendingModelUpdate && _HasSettledDynamicPrims()) {
+        _pendingModelUpdate = true;
+        worldDirty = true;
+        settleOnly = true;
+    }
+
     // add mesh instances to world
     if (_pendingModelUpdate)
         ProcessInstances();
 
     // add lights to world
-    if (_pendingLightUpdate) {
-        ProcessLights();
-        lightsDirty = true;
-    }
+    if (_pendingLightUpdate)
+        lightsDirty = ProcessLights();
 
     // world commit to prepare render
-    if (_world && (worldDirty || lightsDirty)) {
-        _world.commit();
+    if (worldDirty || lightsDirty) {
+        _CommitWorld(!settleOnly || lightsDirty);
+    }
+
+    // swap decoded textures into their placeholders.  Materials whose
+    // textures failed to load are synced again with the next frame and fall
+    // back to their constant values.
+    bool texturesFailed = false;
+    if (_renderParam->GetTextureCache().CommitLoadedTextures(texturesFailed))
+        _pendingResetImage = true;
+    if (texturesFailed) {
+        HdChangeTracker& changeTracker = GetRenderIndex()->GetChangeTracker();
+        for (SdfPath const& id : GetRenderIndex()->GetSprimSubtree(
+                    HdPrimTypeTokens->material, SdfPath::AbsoluteRootPath()))
+            changeTracker.MarkSprimDirty(id, HdMaterial::DirtyResource);
+    }
+
+    // swap in the newest world whose BVH is built
+    int committedSerial = 0;
+    opp::World committedWorld
+           = _worldCommitter.TakeCommittedWorld(committedSerial);
+    if (committedWorld) {
+        _world = committedWorld;
+        _worldSerial = committedSerial;
+        _pendingResetImage |= _pendingWorldResetsImage;
+        if (committedSerial == _pendingWorldSerial) {
+            _pendingWorld = nullptr;
+            _pendingWorldResetsImage = false;
+        }
     }
 
     if (_rendererDirty) {
@@ -592,13 +706,25 @@ HdOSPRayRenderPass::_Execute(HdRenderPassStateSharedPtr const& renderPassState,
     if (_interacting)
         frameBuffer = _interactiveFrameBuffer;
 
+    // The previous frame finished or was cancelled above, unless the AOVs
+    // changed.  Once it is done, resources retired before _world was created
+    // are no longer rendered by this pass.
+    if (_currentFrame.isValid() && !_currentFrame.osprayFrame.isReady()) {
+        _currentFrame.osprayFrame.cancel();
+        _currentFrame.osprayFrame.wait();
+    }
+    _renderParam->ReleaseRetiredResources(this, _worldSerial);
+    // textures released by materials during sync
+    _renderParam->GetTextureCache().Trim();
+
     // Render the frame.  Display will occur in subsequent execute calls
-    if (!IsConverged()) {
+    if ((unsigned int)_numSamplesAccumulated
+        < (unsigned int)_samplesToConvergence) {
         _currentFrame.osprayFrame
                = frameBuffer.renderFrame(_renderer, _camera, _world);
         if (!_interacting)
             _numSamplesAccumulated += std::max(1, _spp);
-    } else {
+    } else if (!_pendingWorld) {
         for (int aovIndex = 0; aovIndex < _aovBindings.size(); aovIndex++) {
             auto ospRenderBuffer = dynamic_cast<HdOSPRayRenderBuffer*>(
                    _aovBindings[aovIndex].renderBuffer);
@@ -732,7 +858,7 @@ HdOSPRayRenderPass::ProcessCamera(
     _camera.commit();
 }
 
-void
+bool
 HdOSPRayRenderPass::ProcessLights()
 {
     GfVec3f origin = GfVec3f(0, 0, 0);
@@ -750,82 +876,145 @@ HdOSPRayRenderPass::ProcessLights()
     }
     GfVec3f right_light = GfCross(dir, up);
     std::vector<opp::Light> lights;
+    lights.reserve(_worldLights.size());
 
-    // push scene lights
+    // push scene lights.  Lights update their OSPRay light in place, so
+    // only added, removed or replaced lights change the list.  Local lights
+    // are gathered separately if they can be clustered.
+    std::vector<opp::Light> localLights;
+    std::vector<HdOSPRayLightProxy> proxies;
     for (auto l : _renderParam->GetHdOSPRayLights()) {
-        if (l.second->IsVisible())
+        if (!l.second->IsVisible())
+            continue;
+        HdOSPRayLightProxy proxy;
+        if (_lightClustering && l.second->GetLightProxy(proxy)) {
+            localLights.push_back(l.second->GetOSPLight());
+            proxies.push_back(proxy);
+        } else
             lights.push_back(l.second->GetOSPLight());
     }
 
+    // while rendering interactively, local lights are replaced by a cut
+    // through their cluster hierarchy
+    _lightClustersActive = _lightClustering && _interacting;
+    if (_lightClustersActive) {
+        if (_lightClusterTreeDirty) {
+            _lightClusterTree.Build(proxies, localLights);
+            _lightClusterTreeDirty = false;
+        }
+        if (_lightClusterTree.UpdateCut(origin, _lightClusterThreshold))
+            _lightClusterTree.CommitCut();
+        auto const& cutLights = _lightClusterTree.GetCutLights();
+        lights.insert(lights.end(), cutLights.begin(), cutLights.end());
+    } else
+        lights.insert(lights.end(), localLights.begin(), localLights.end());
+
     float glToPTLightIntensityMultiplier = 1.f;
     if (_eyeLight || _keyLight || _fillLight || _backLight)
         glToPTLightIntensityMultiplier /= 1.8f;
 
+    // the default lights persist and are only reparameterized when their
+    // frame or intensity changed
+    const bool defaultLightsDirty = dir_light != _defaultLightDir
+           || up_light != _defaultLightUp
+           || glToPTLightIntensityMultiplier != _defaultLightScale;
+    _defaultLightDir = dir_light;
+    _defaultLightUp = up_light;
+    _defaultLightScale = glToPTLightIntensityMultiplier;
+
     if (_eyeLight) {
-        auto eyeLight = opp::Light("distant");
-        eyeLight.setParam("color", vec3f(1.f, 232.f / 255.f, 166.f / 255.f));
-        eyeLight.setParam("direction",
-                          vec3f(dir_light[0], dir_light[1], dir_light[2]));
-        eyeLight.setParam("intensity", glToPTLightIntensityMultiplier);
-        eyeLight.setParam("visible", false);
-        eyeLight.commit();
-        lights.push_back(eyeLight);
+        if (!_ospEyeLight || defaultLightsDirty) {
+            if (!_ospEyeLight)
+                _ospEyeLight = opp::Light("distant");
+            _ospEyeLight.setParam(
+                   "color", vec3f(1.f, 232.f / 255.f, 166.f / 255.f));
+            _ospEyeLight.setParam(
+                   "direction",
+                   vec3f(dir_light[0], dir_light[1], dir_light[2]));
+            _ospEyeLight.setParam("intensity",
+                                  glToPTLightIntensityMultiplier);
+            _ospEyeLight.setParam("visible", false);
+            _ospEyeLight.commit();
+        }
+        lights.push_back(_ospEyeLight);
     }
     const float angularDiameter = 4.5f;
     if (_keyLight) {
-        auto keyLight = opp::Light("distant");
-        auto keyHorz = -1.0f / tan(rad(45.0f)) * right_light;
-        auto keyVert = 1.0f / tan(rad(70.0f)) * up_light;
-        auto lightDir = -(keyVert + keyHorz);
-        keyLight.setParam("color", vec3f(.8f, .8f, .8f));
-        keyLight.setParam("direction",
-                          vec3f(lightDir[0], lightDir[1], lightDir[2]));
-        keyLight.setParam("intensity", glToPTLightIntensityMultiplier * 1.3f);
-        keyLight.setParam("angularDiameter", angularDiameter);
-        keyLight.setParam("visible", false);
-        keyLight.commit();
-        lights.push_back(keyLight);
+        if (!_ospKeyLight || defaultLightsDirty) {
+            if (!_ospKeyLight)
+                _ospKeyLight = opp::Light("distant");
+            auto keyHorz = -1.0f / tan(rad(45.0f)) * right_light;
+            auto keyVert = 1.0f / tan(rad(70.0f)) * up_light;
+            auto lightDir = -(keyVert + keyHorz);
+            _ospKeyLight.setParam("color", vec3f(.8f, .8f, .8f));
+            _ospKeyLight.setParam(
+                   "direction", vec3f(lightDir[0], lightDir[1], lightDir[2]));
+            _ospKeyLight.setParam("intensity",
+                                  glToPTLightIntensityMultiplier * 1.3f);
+            _ospKeyLight.setParam("angularDiameter", angularDiameter);
+            _ospKeyLight.setParam("visible", false);
+            _ospKeyLight.commit();
+        }
+        lights.push_back(_ospKeyLight);
     }
     if (_fillLight) {
-        auto fillLight = opp::Light("distant");
-        auto fillHorz = 1.0f / tan(rad(30.0f)) * right_light;
-        auto fillVert = 1.0f / tan(rad(45.0f)) * up_light;
-        auto lightDir = (fillVert + fillHorz);
-        fillLight.setParam("color", vec3f(.6f, .6f, .6f));
-        fillLight.setParam("direction",
-                           vec3f(lightDir[0], lightDir[1], lightDir[2]));
-        fillLight.setParam("intensity", glToPTLightIntensityMultiplier);
-        fillLight.setParam("angularDiameter", angularDiameter);
-        fillLight.setParam("visible", false);
-        fillLight.commit();
-        lights.push_back(fillLight);
+        if (!_ospFillLight || defaultLightsDirty) {
+            if (!_ospFillLight)
+                _ospFillLight = opp::Light("distant");
+            auto fillHorz = 1.0f / tan(rad(30.0f)) * right_light;
+            auto fillVert = 1.0f / tan(rad(45.0f)) * up_light;
+            auto lightDir = (fillVert + fillHorz);
+            _ospFillLight.setParam("color", vec3f(.6f, .6f, .6f));
+            _ospFillLight.setParam(
+                   "direction", vec3f(lightDir[0], lightDir[1], lightDir[2]));
+            _ospFillLight.setParam("intensity",
+                                   glToPTLightIntensityMultiplier);
+            _ospFillLight.setParam("angularDiameter", angularDiameter);
+            _ospFillLight.setParam("visible", false);
+            _ospFillLight.commit();
+        }
+        lights.push_back(_ospFillLight);
     }
     if (_backLight) {
-        auto backLight = opp::Light("distant");
-        auto backHorz = 1.0f / tan(rad(60.0f)) * right_light;
-        auto backVert = -1.0f / tan(rad(60.0f)) * up_light;
-        auto lightDir = (backHorz + backVert);
-        backLight.setParam("color", vec3f(.6f, .6f, .6f));
-        backLight.setParam("direction",
-                           vec3f(lightDir[0], lightDir[1], lightDir[2]));
-        backLight.setParam("intensity", glToPTLightIntensityMultiplier);
-        backLight.setParam("angularDiameter", angularDiameter);
-        backLight.setParam("visible", false);
-        backLight.commit();
-        lights.push_back(backLight);
+        if (!_ospBackLight || defaultLightsDirty) {
+            if (!_ospBackLight)
+                _ospBackLight = opp::Light("distant");
+            auto backHorz = 1.0f / tan(rad(60.0f)) * right_light;
+            auto backVert = -1.0f / tan(rad(60.0f)) * up_light;
+            auto lightDir = (backHorz + backVert);
+            _ospBackLight.setParam("color", vec3f(.6f, .6f, .6f));
+            _ospBackLight.setParam(
+                   "direction", vec3f(lightDir[0], lightDir[1], lightDir[2]));
+            _ospBackLight.setParam("intensity",
+                                   glToPTLightIntensityMultiplier);
+            _ospBackLight.setParam("angularDiameter", angularDiameter);
+            _ospBackLight.setParam("visible", false);
+            _ospBackLight.commit();
+        }
+        lights.push_back(_ospBackLight);
     }
     if (_ambientLight || lights.empty()) {
-        auto ambient = opp::Light("ambient");
-        ambient.setParam("color", vec3f(1.f, 1.f, 1.f));
-        ambient.setParam("intensity", glToPTLightIntensityMultiplier * 0.5f);
-        ambient.setParam("visible", false);
-        ambient.commit();
-        lights.push_back(ambient);
-    }
-    if (_world) {
-        _world.setParam("light", opp::CopiedData(lights));
+        if (!_ospAmbientLight || defaultLightsDirty) {
+            if (!_ospAmbientLight)
+                _ospAmbientLight = opp::Light("ambient");
+            _ospAmbientLight.setParam("color", vec3f(1.f, 1.f, 1.f));
+            _ospAmbientLight.setParam("intensity",
+                                      glToPTLightIntensityMultiplier * 0.5f);
+            _ospAmbientLight.setParam("visible", false);
+            _ospAmbientLight.commit();
+        }
+        lights.push_back(_ospAmbientLight);
     }
     _pendingLightUpdate = false;
+
+    // lights edited in place are picked up by the committed world
+    bool listChanged = lights.size() != _worldLights.size();
+    for (size_t i = 0; !listChanged && i < lights.size(); i++)
+        listChanged = lights[i].handle() != _worldLights[i].handle();
+    if (!listChanged)
+        return false;
+    _worldLights = std::move(lights);
+    return true;
 }
 
 void
@@ -930,6 +1119,48 @@ HdOSPRayRenderPass::ProcessSettings()
     bool backLight = renderDelegate->GetRenderSetting<bool>(
            HdOSPRayRenderSettingsTokens->backLight, false);
 
+    bool instanceCulling = renderDelegate->GetRenderSetting<bool>(
+           HdOSPRayRenderSettingsTokens->instanceCulling,
+           HdOSPRayConfig::GetInstance().instanceCulling);
+    float cullingFrustumMargin = renderDelegate->GetRenderSetting<float>(
+           HdOSPRayRenderSettingsTokens->cullingFrustumMargin,
+           _cullingFrustumMargin);
+    float cullingMaxDistance = renderDelegate->GetRenderSetting<float>(
+           HdOSPRayRenderSettingsTokens->cullingMaxDistance,
+           _cullingMaxDistance);
+    float cullingMinSize = renderDelegate->GetRenderSetting<float>(
+           HdOSPRayRenderSettingsTokens->cullingMinSize, _cullingMinSize);
+
+    // checks if the culling settings changed
+    if (instanceCulling != _instanceCulling
+        || cullingFrustumMargin != _cullingFrustumMargin
+        || cullingMaxDistance != _cullingMaxDistance
+        || cullingMinSize != _cullingMinSize) {
+        _instanceCulling = instanceCulling;
+        _cullingFrustumMargin = cullingFrustumMargin;
+        _cullingMaxDistance = cullingMaxDistance;
+        _cullingMinSize = cullingMinSize;
+        _cullingLevel = HDOSPRAY_CULLING_RESTORE_STEPS;
+        _culledClusters.clear();
+        _pendingModelUpdate = true;
+        _pendingResetImage = true;
+    }
+
+    bool lightClustering = renderDelegate->GetRenderSetting<bool>(
+           HdOSPRayRenderSettingsTokens->lightClustering,
+           HdOSPRayConfig::GetInstance().lightClustering);
+    float lightClusterThreshold = renderDelegate->GetRenderSetting<float>(
+           HdOSPRayRenderSettingsTokens->lightClusterThreshold,
+           _lightClusterThreshold);
+    if (lightClustering != _lightClustering
+        || lightClusterThreshold != _lightClusterThreshold) {
+        _lightClustering = lightClustering;
+        _lightClusterThreshold = lightClusterThreshold;
+        _lightClusterTreeDirty = true;
+        _pendingLightUpdate = true;
+        _pendingResetImage = true;
+    }
+
     // checks if the lighting in the scene changed
     if (ambientLight != _ambientLight
         || staticDirectionalLights != _staticDirectionalLights
@@ -949,28 +1180,236 @@ HdOSPRayRenderPass::ProcessSettings()
 void
 HdOSPRayRenderPass::ProcessInstances()
 {
-    // release resources from last committed scene
-    _oldInstances.resize(0);
-    // create new model and populate with mesh instances
-    for (auto hdOSPRayMesh : _renderParam->GetHdOSPRayMeshes()) {
+    HdOSPRayInstanceCuller culler;
+    const HdOSPRayInstanceCuller* activeCuller
+           = _GetInstanceCuller(culler) ? &culler : nullptr;
+
+    // Instances of static prims are gathered only when the static part of
+    // the scene or the collection changed.  Culling applies to all prims,
+    // so it bypasses the cache.
+    const int syncFrame = _renderParam->GetSyncFrame();
+    const int staticModelVersion = _renderParam->GetStaticModelVersion();
+    if (activeCuller || staticModelVersion != _lastStaticModelVersion
+        || _collectionDirty || _HasSettledDynamicPrims()) {
+        // settled prims switch back to high quality BVH builds.  Prims
+        // removed since they were gathered are skipped.
+        for (auto& taggedPrims : _taggedPrims) {
+            for (auto hdOSPRayMesh : taggedPrims.second.dynamicMeshes) {
+                if (_renderParam->HasHdOSPRayMesh(hdOSPRayMesh))
+                    hdOSPRayMesh->UpdateBuildQuality(syncFrame);
+            }
+            for (auto hdOSPRayBasisCurves :
+                 taggedPrims.second.dynamicBasisCurves) {
+                if (_renderParam->HasHdOSPRayBasisCurves(hdOSPRayBasisCurves))
+                    hdOSPRayBasisCurves->UpdateBuildQuality(syncFrame);
+            }
+        }
+        _taggedPrims.clear();
+        HdRenderIndex* renderIndex = GetRenderIndex();
+        for (auto hdOSPRayMesh : _renderParam->GetHdOSPRayMeshes()) {
+            SdfPath const& id = hdOSPRayMesh->GetId();
+            if (!_IsInCollection(id))
+                continue;
+            _TaggedPrims& prims = _taggedPrims[renderIndex->GetRenderTag(id)];
+            if (!activeCuller && hdOSPRayMesh->IsDynamic(syncFrame))
+                prims.dynamicMeshes.push_back(hdOSPRayMesh);
+            else
+                hdOSPRayMesh->AddOSPInstances(prims.staticInstances,
+                                              activeCuller);
+        }
+        for (auto hdOSPRayBasisCurves :
+             _renderParam->GetHdOSPRayBasisCurves()) {
+            SdfPath const& id = hdOSPRayBasisCurves->GetId();
+            if (!_IsInCollection(id))
+                continue;
+            _TaggedPrims& prims = _taggedPrims[renderIndex->GetRenderTag(id)];
+            if (!activeCuller && hdOSPRayBasisCurves->IsDynamic(syncFrame))
+                prims.dynamicBasisCurves.push_back(hdOSPRayBasisCurves);
+            else
+                hdOSPRayBasisCurves->AddOSPInstances(prims.staticInstances,
+                                                     activeCuller);
+        }
+        _lastStaticModelVersion = activeCuller ? -1 : staticModelVersion;
+        _collectionDirty = false;
+        _renderTagsDirty = true;
+    }
+
+    // assemble the prims of the active render tags
+    if (_renderTagsDirty) {
+        _oldInstances.resize(0);
+        _dynamicMeshes.clear();
+        _dynamicBasisCurves.clear();
+        for (auto const& taggedPrims : _taggedPrims) {
+            if (!_IsActiveRenderTag(taggedPrims.first))
+                continue;
+            _TaggedPrims const& prims = taggedPrims.second;
+            _oldInstances.insert(_oldInstances.end(),
+                                 prims.staticInstances.begin(),
+                                 prims.staticInstances.end());
+            _dynamicMeshes.insert(_dynamicMeshes.end(),
+                                  prims.dynamicMeshes.begin(),
+                                  prims.dynamicMeshes.end());
+            _dynamicBasisCurves.insert(_dynamicBasisCurves.end(),
+                                       prims.dynamicBasisCurves.begin(),
+                                       prims.dynamicBasisCurves.end());
+        }
+        _numStaticInstances = _oldInstances.size();
+        _renderTagsDirty = false;
+    }
+
+    // only the instances of dynamic prims are gathered again
+    _oldInstances.resize(_numStaticInstances);
+    for (auto hdOSPRayMesh : _dynamicMeshes) {
         hdOSPRayMesh->AddOSPInstances(_oldInstances);
     }
-    for (auto hdOSPRayBasisCurves : _renderParam->GetHdOSPRayBasisCurves()) {
+    for (auto hdOSPRayBasisCurves : _dynamicBasisCurves) {
         hdOSPRayBasisCurves->AddOSPInstances(_oldInstances);
     }
-    TF_DEBUG_MSG(OSP_RP, "ospRP::process instances %zu\n",
-                 _oldInstances.size());
+    _worldInstanceData = nullptr;
     if (!_oldInstances.empty()) {
-        opp::CopiedData data = opp::CopiedData(
+        _worldInstanceData = opp::CopiedData(
                _oldInstances.data(), OSP_INSTANCE, _oldInstances.size());
-        data.commit();
-        _world.setParam("instance", data);
-    } else {
-        _world.removeParam("instance");
+        _worldInstanceData.commit();
     }
+    TF_DEBUG_MSG(OSP_RP, "ospRP::process instances %zu (%zu static)\n",
+                 _oldInstances.size(), _numStaticInstances);
+
+    // favor fast BVH builds while prims animate and save memory on huge
+    // instance counts
+    _worldBuildQuality = HdOSPRayBuildQuality::ComputeWorld(
+           !_dynamicMeshes.empty() || !_dynamicBasisCurves.empty(),
+           _oldInstances.size());
     _pendingModelUpdate = false;
 }
 
+void
+HdOSPRayRenderPass::_CommitWorld(bool resetImage)
+{
+    // the instance data is shared with the previous world if only the
+    // lights changed
+    opp::World world;
+    const int serial = _renderParam->NextWorldSerial();
+    if (_worldInstanceData)
+        world.setParam("instance", _worldInstanceData);
+    if (!_worldLights.empty()) {
+        world.setParam("light", opp::CopiedData(_worldLights));
+    }
+    world.setParam("dynamicScene", _worldBuildQuality.dynamicScene);
+    world.setParam("compactMode", _worldBuildQuality.compactMode);
+
+    // The first world is committed in place, as there is nothing to show
+    // until it is built.  Afterwards only the commit runs on the background
+    // task, all other OSPRay calls stay on this thread.  A world still
+    // queued is superseded by this one.
+    if (HdOSPRayConfig::GetInstance().asyncWorldCommit && _worldCommitted) {
+        // a superseded pending world still owes its reset
+        _pendingWorldResetsImage
+               = resetImage || (_pendingWorld && _pendingWorldResetsImage);
+        _pendingWorld = world;
+        _pendingWorldSerial = serial;
+        _worldCommitter.Commit(world, serial);
+    } else {
+        world.commit();
+        _world = world;
+        _worldSerial = serial;
+        _pendingWorld = nullptr;
+        _pendingResetImage |= resetImage;
+        _worldCommitted = true;
+    }
+}
+
+bool
+HdOSPRayRenderPass::_GetInstanceCuller(HdOSPRayInstanceCuller& culler) const
+{
+    if (!_instanceCulling || _cullingLevel >= HDOSPRAY_CULLING_RESTORE_STEPS)
+        return false;
+
+    // the culling volume grows with each restore step after the camera
+    // stopped
+    const float relax = float(1 << _cullingLevel);
+    culler.worldToClip = _worldToClipMatrix;
+    culler.eye = _inverseViewMatrix.Transform(GfVec3d(0.0));
+    culler.frustumMargin = _cullingFrustumMargin * relax;
+    culler.maxDistance = _cullingMaxDistance * relax;
+    culler.minSize = _cullingMinSize / relax;
+    return true;
+}
+
+bool
+HdOSPRayRenderPass::_UpdateCulledClusters()
+{
+    HdOSPRayInstanceCuller culler;
+    const HdOSPRayInstanceCuller* activeCuller
+           = _GetInstanceCuller(culler) ? &culler : nullptr;
+
+    // scene changes rebuild the world on their own, so the visibility of
+    // the prims' clusters only needs to match the last culling step
+    std::vector<bool> visible;
+    visible.reserve(_culledClusters.size());
+    HdRenderIndex* renderIndex = GetRenderIndex();
+    for (auto hdOSPRayMesh : _renderParam->GetHdOSPRayMeshes()) {
+        SdfPath const& id = hdOSPRayMesh->GetId();
+        if (_IsInCollection(id)
+            && _IsActiveRenderTag(renderIndex->GetRenderTag(id)))
+            hdOSPRayMesh->CullOSPInstances(activeCuller, visible);
+    }
+    for (auto hdOSPRayBasisCurves :
+         _renderParam->GetHdOSPRayBasisCurves()) {
+        SdfPath const& id = hdOSPRayBasisCurves->GetId();
+        if (_IsInCollection(id)
+            && _IsActiveRenderTag(renderIndex->GetRenderTag(id)))
+            hdOSPRayBasisCurves->CullOSPInstances(activeCuller, visible);
+    }
+
+    if (visible == _culledClusters)
+        return false;
+    _culledClusters.swap(visible);
+    return true;
+}
+
+bool
+HdOSPRayRenderPass::_IsInCollection(SdfPath const& id) const
+{
+    HdRprimCollection const& collection = GetRprimCollection();
+    for (SdfPath const& excludePath : collection.GetExcludePaths()) {
+        if (id.HasPrefix(excludePath))
+            return false;
+    }
+    for (SdfPath const& rootPath : collection.GetRootPaths()) {
+        if (id.HasPrefix(rootPath))
+            return true;
+    }
+    return false;
+}
+
+bool
+HdOSPRayRenderPass::_IsActiveRenderTag(TfToken const& renderTag) const
+{
+    return _renderTags.empty()
+           || std::find(_renderTags.begin(), _renderTags.end(), renderTag)
+                  != _renderTags.end();
+}
+
+bool
+HdOSPRayRenderPass::_HasSettledDynamicPrims() const
+{
+    // removing prims changes the static model version, the gathered prims
+    // may be gone and are gathered again anyway
+    if (_renderParam->GetStaticModelVersion() != _lastStaticModelVersion)
+        return false;
+
+    const int syncFrame = _renderParam->GetSyncFrame();
+    for (auto hdOSPRayMesh : _dynamicMeshes) {
+        if (!hdOSPRayMesh->IsDynamic(syncFrame))
+            return true;
+    }
+    for (auto hdOSPRayBasisCurves : _dynamicBasisCurves) {
+        if (!hdOSPRayBasisCurves->IsDynamic(syncFrame))
+            return true;
+    }
+    return false;
+}
+
 void
 HdOSPRayRenderPass::SetAovBindings(
        HdRenderPassAovBindingVector const& aovBindings)
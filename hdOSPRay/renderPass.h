@@ -16,17 +16,102 @@
 
 #include <pxr/base/work/loops.h>
 
+#include <tbb/task_group.h>
+
+#include <map>
+#include <mutex>
+
 #include "config.h"
+#include "lights/lightClusters.h"
+#include "renderDelegate.h"
 
 namespace opp = ospray::cpp;
 
 using namespace rkcommon::math;
 
+// number of frames over which culled instances are restored once the camera
+// stops moving
+#define HDOSPRAY_CULLING_RESTORE_STEPS 3
+
 PXR_NAMESPACE_USING_DIRECTIVE
 TF_DEBUG_CODES(OSP_RP);
 TF_DEBUG_CODES(OSP_FPS);
 
 class HdOSPRayRenderParam;
+class HdOSPRayMesh;
+class HdOSPRayBasisCurves;
+struct HdOSPRayInstanceCuller;
+
+///
+/// \class HdOSPRayWorldCommitter
+///
+/// Commits the worlds of a render pass on a background task.  A world
+/// queued behind the running commit is superseded by the next one and never
+/// committed, so queuing a world never waits for the BVH build of an older
+/// one.  Prims never modify OSPRay objects a world references, they create
+/// new ones, so syncs do not wait for the background commit either.
+///
+class HdOSPRayWorldCommitter {
+public:
+    ~HdOSPRayWorldCommitter()
+    {
+        _tasks.wait();
+    }
+
+    // Queues world with its serial for the background commit
+    void Commit(opp::World world, int serial)
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _queuedWorld = world;
+        _queuedSerial = serial;
+        if (_running)
+            return;
+        _running = true;
+        _tasks.run([this]() { _CommitQueuedWorlds(); });
+    }
+
+    // Returns the world committed last since the previous call and sets
+    // serial to its serial, or returns a null world
+    opp::World TakeCommittedWorld(int& serial)
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        opp::World world = _committedWorld;
+        serial = _committedSerial;
+        _committedWorld = nullptr;
+        return world;
+    }
+
+private:
+    void _CommitQueuedWorlds()
+    {
+        for (;;) {
+            opp::World world;
+            int serial = 0;
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                if (!_queuedWorld) {
+                    _running = false;
+                    return;
+                }
+                world = _queuedWorld;
+                serial = _queuedSerial;
+                _queuedWorld = nullptr;
+            }
+            world.commit();
+            std::lock_guard<std::mutex> lock(_mutex);
+            _committedWorld = world;
+            _committedSerial = serial;
+        }
+    }
+
+    std::mutex _mutex;
+    tbb::task_group _tasks;
+    bool _running { false };
+    opp::World _queuedWorld = nullptr;
+    int _queuedSerial { 0 };
+    opp::World _committedWorld = nullptr;
+    int _committedSerial { 0 };
+};
 
 /// \class HdOSPRayRenderPass
 class HdOSPRayRenderPass final : public HdRenderPass {
@@ -102,7 +187,8 @@ protected:
 
     virtual void
     ProcessCamera(HdRenderPassStateSharedPtr const& renderPassState);
-    virtual void ProcessLights();
+    // Returns true if the light list of the world changed
+    virtual bool ProcessLights();
     virtual void ProcessSettings();
     virtual void ProcessInstances();
 
@@ -145,6 +231,28 @@ private:
     // Return the clear color to use for the given VtValue
     static GfVec4f _ComputeClearColor(VtValue const& clearValue);
 
+    // Whether any prim gathered as dynamic has stopped changing
+    bool _HasSettledDynamicPrims() const;
+
+    // Whether the prim is included by the rprim collection of the pass
+    bool _IsInCollection(SdfPath const& id) const;
+
+    // Whether prims with the render tag are rendered
+    bool _IsActiveRenderTag(TfToken const& renderTag) const;
+
+    // Sets up culler for the current culling level, returns false if
+    // nothing is culled at it
+    bool _GetInstanceCuller(HdOSPRayInstanceCuller& culler) const;
+
+    // Culls the instance clusters of all rendered prims for the current
+    // culling level, returns true if the visible clusters changed
+    bool _UpdateCulledClusters();
+
+    // Creates a new world from the current instances and lights and commits
+    // it, in the background if asynchronous world commits are enabled.
+    // resetImage is false if the world renders the same image as _world.
+    void _CommitWorld(bool resetImage = true);
+
     bool _pendingResetImage { true };
     bool _pendingModelUpdate { true };
     bool _pendingLightUpdate { true };
@@ -183,6 +291,7 @@ private:
 
     int _lastRenderedModelVersion { -1 };
     int _lastRenderedLightVersion { -1 };
+    int _lastRenderedMaterialVersion { -1 };
     int _lastSettingsVersion { -1 };
 
     RenderFrame _currentFrame;
@@ -202,8 +311,58 @@ private:
 
     std::shared_ptr<HdOSPRayRenderParam> _renderParam;
 
-    std::vector<opp::Instance> _oldInstances; // instances added to last model
+    // instances added to last model.  The first _numStaticInstances are
+    // those of prims that did not change recently, they are kept until the
+    // static model version changes.
+    std::vector<opp::Instance> _oldInstances;
+    size_t _numStaticInstances { 0 };
+    int _lastStaticModelVersion { -1 };
+    // prims gathered into _oldInstances every model update
+    std::vector<HdOSPRayMesh*> _dynamicMeshes;
+    std::vector<HdOSPRayBasisCurves*> _dynamicBasisCurves;
+    // prims of the collection gathered per render tag.  The static
+    // instances of _oldInstances, _dynamicMeshes and _dynamicBasisCurves
+    // hold the prims of the active render tags.
+    struct _TaggedPrims {
+        std::vector<opp::Instance> staticInstances;
+        std::vector<HdOSPRayMesh*> dynamicMeshes;
+        std::vector<HdOSPRayBasisCurves*> dynamicBasisCurves;
+    };
+    std::map<TfToken, _TaggedPrims> _taggedPrims;
+    // render tags passed to the last execute, empty renders all tags
+    TfTokenVector _renderTags;
+    bool _renderTagsDirty { true };
+    // the collection or render tags of prims changed
+    bool _collectionDirty { true };
+    int _lastRenderTagVersion { -1 };
     opp::World _world = nullptr; // the last model created
+    // last world queued for the background commit, replaces _world once its
+    // BVH is built.  Superseded worlds already committed replace _world
+    // before.
+    opp::World _pendingWorld = nullptr;
+    HdOSPRayWorldCommitter _worldCommitter;
+    // whether swapping in _pendingWorld resets accumulation
+    bool _pendingWorldResetsImage { true };
+    // serials of _world and _pendingWorld, see
+    // HdOSPRayRenderParam::NextWorldSerial
+    int _worldSerial { 0 };
+    int _pendingWorldSerial { 0 };
+    bool _worldCommitted { false };
+    // world parameters set by ProcessInstances and ProcessLights, applied
+    // to each new world
+    opp::CopiedData _worldInstanceData = nullptr;
+    std::vector<opp::Light> _worldLights;
+    // default lights, kept across light updates
+    opp::Light _ospEyeLight = nullptr;
+    opp::Light _ospKeyLight = nullptr;
+    opp::Light _ospFillLight = nullptr;
+    opp::Light _ospBackLight = nullptr;
+    opp::Light _ospAmbientLight = nullptr;
+    // camera frame and intensity the default lights were set up with
+    GfVec3f _defaultLightDir { 0.f };
+    GfVec3f _defaultLightUp { 0.f };
+    float _defaultLightScale { 0.f };
+    HdOSPRayBuildQuality _worldBuildQuality;
 
     int _numSamplesAccumulated { 0 }; // number of rendered frames not cleared
     int _spp { HDOSPRAY_DEFAULT_SPP };
@@ -233,4 +392,25 @@ private:
 
     float _aoRadius { HDOSPRAY_DEFAULT_AO_RADIUS };
     float _aoIntensity { HDOSPRAY_DEFAULT_AO_INTENSITY };
+
+    // instance culling during camera interaction
+    bool _instanceCulling { HDOSPRAY_DEFAULT_INSTANCE_CULLING };
+    float _cullingFrustumMargin { HDOSPRAY_DEFAULT_CULLING_FRUSTUM_MARGIN };
+    float _cullingMaxDistance { HDOSPRAY_DEFAULT_CULLING_MAX_DISTANCE };
+    float _cullingMinSize { HDOSPRAY_DEFAULT_CULLING_MIN_SIZE };
+    // 0 while the camera moves, counts up to HDOSPRAY_CULLING_RESTORE_STEPS
+    // (no culling) once it stops
+    int _cullingLevel { HDOSPRAY_CULLING_RESTORE_STEPS };
+    // visibility of the instance clusters of the last culling step
+    std::vector<bool> _culledClusters;
+    GfMatrix4d _worldToClipMatrix { 1.0 };
+
+    // light clustering during interactive rendering
+    bool _lightClustering { HDOSPRAY_DEFAULT_LIGHT_CLUSTERING };
+    float _lightClusterThreshold { HDOSPRAY_DEFAULT_LIGHT_CLUSTER_THRESHOLD };
+    HdOSPRayLightClusterTree _lightClusterTree;
+    // the hierarchy is rebuilt on the next light update if lights changed
+    bool _lightClusterTreeDirty { true };
+    // whether the light list holds the cluster cut
+    bool _lightClustersActive { false };
 };
\ No newline at end of file
@@ -4,14 +4,29 @@
 #include "texture.h"
 #include "config.h"
 
+#include <pxr/base/arch/fileSystem.h>
+#include <pxr/base/tf/atomicOfstreamWrapper.h>
+#include <pxr/base/tf/fileUtils.h>
+#include <pxr/base/tf/stringUtils.h>
 #include <pxr/imaging/hd/tokens.h>
 #include <pxr/usd/ar/resolver.h>
 #include <pxr/usd/sdf/assetPath.h>
 
 #include <rkcommon/math/vec.h>
 
+#include <OpenImageIO/imagecache.h>
 #include <OpenImageIO/imageio.h>
 
+#include <tbb/blocked_range.h>
+#include <tbb/parallel_for.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <cstring>
+#include <limits>
+#include <type_traits>
+
 using namespace rkcommon::math;
 
 OIIO_NAMESPACE_USING
@@ -28,6 +43,15 @@ osprayTextureFormat(int depth, int channels, bool preferLinear)
             return preferLinear ? OSP_TEXTURE_RGB8 : OSP_TEXTURE_SRGB;
         if (channels == 4)
             return preferLinear ? OSP_TEXTURE_RGBA8 : OSP_TEXTURE_SRGBA;
+    } else if (depth == 2) {
+        if (channels == 1)
+            return OSP_TEXTURE_R16;
+        if (channels == 2)
+            return OSP_TEXTURE_RA16;
+        if (channels == 3)
+            return OSP_TEXTURE_RGB16;
+        if (channels == 4)
+            return OSP_TEXTURE_RGBA16;
     } else if (depth == 4) {
         if (channels == 1)
             return OSP_TEXTURE_R32F;
@@ -40,6 +64,57 @@ osprayTextureFormat(int depth, int channels, bool preferLinear)
     return OSP_TEXTURE_FORMAT_INVALID;
 }
 
+static OSPDataType
+_TextureDataType(OSPTextureFormat format)
+{
+    if (format == OSP_TEXTURE_R32F)
+        return OSP_FLOAT;
+    if (format == OSP_TEXTURE_RGB32F)
+        return OSP_VEC3F;
+    if (format == OSP_TEXTURE_RGBA32F)
+        return OSP_VEC4F;
+    if ((format == OSP_TEXTURE_R8) || (format == OSP_TEXTURE_L8))
+        return OSP_UCHAR;
+    if ((format == OSP_TEXTURE_RGB8) || (format == OSP_TEXTURE_SRGB))
+        return OSP_VEC3UC;
+    if (format == OSP_TEXTURE_RGBA8 || format == OSP_TEXTURE_SRGBA)
+        return OSP_VEC4UC;
+    if ((format == OSP_TEXTURE_RA8) || (format == OSP_TEXTURE_LA8))
+        return OSP_VEC2UC;
+    if (format == OSP_TEXTURE_R16)
+        return OSP_USHORT;
+    if (format == OSP_TEXTURE_RA16)
+        return OSP_VEC2US;
+    if (format == OSP_TEXTURE_RGB16)
+        return OSP_VEC3US;
+    if (format == OSP_TEXTURE_RGBA16)
+        return OSP_VEC4US;
+    return OSP_UNKNOWN;
+}
+
+template <typename T>
+static void
+_Complement(T* values, size_t count, T one)
+{
+    tbb::parallel_for(tbb::blocked_range<size_t>(0, count),
+                      [&](tbb::blocked_range<size_t> const& r) {
+                          for (size_t i = r.begin(); i < r.end(); i++)
+                              values[i] = one - values[i];
+                      });
+}
+
+// computes 1-val in place for texels of 1, 2 or 4 bytes per channel
+static void
+_Complement(std::vector<unsigned char>& data, int depth)
+{
+    if (depth == 1)
+        _Complement<unsigned char>(data.data(), data.size(), 255);
+    else if (depth == 2)
+        _Complement<uint16_t>((uint16_t*)data.data(), data.size() / 2, 65535);
+    else
+        _Complement<float>((float*)data.data(), data.size() / 4, 1.f);
+}
+
 /// creates ptex texture and sets to file, does not commit
 opp::Texture
 LoadPtexTexture(std::string file)
@@ -52,141 +127,333 @@ LoadPtexTexture(std::string file)
     return ospTexture;
 }
 
-// creates 2d osptexture from file, does not commit
-std::pair<opp::Texture, unsigned char*>
-LoadOIIOTexture2D(std::string file, std::string channelsStr, bool nearestFilter,
-                  bool complement)
+static bool
+_SeekMipLevel(ImageInput& in, int level, ImageSpec& spec)
+{
+#if OIIO_VERSION >= 20000
+    if (!in.seek_subimage(0, level))
+        return false;
+    spec = in.spec();
+    return true;
+#else
+    return in.seek_subimage(0, level, spec);
+#endif
+}
+
+// halves the resolution of an image by averaging 2x2 texel blocks
+template <typename T>
+static void
+_BoxDownsample(std::vector<unsigned char>& data, vec2i& size, int channels)
+{
+    const vec2i outSize { std::max(1, size.x / 2), std::max(1, size.y / 2) };
+    std::vector<unsigned char> outData(size_t(outSize.x) * outSize.y
+                                       * channels * sizeof(T));
+    const T* in = (const T*)data.data();
+    T* out = (T*)outData.data();
+    const float round = std::is_integral<T>::value ? .5f : 0.f;
+    tbb::parallel_for(0, outSize.y, [&](int y) {
+        const size_t row0 = size_t(std::min(2 * y, size.y - 1)) * size.x;
+        const size_t row1 = size_t(std::min(2 * y + 1, size.y - 1)) * size.x;
+        for (int x = 0; x < outSize.x; x++) {
+            const size_t x0 = std::min(2 * x, size.x - 1);
+            const size_t x1 = std::min(2 * x + 1, size.x - 1);
+            for (int c = 0; c < channels; c++) {
+                const float sum = float(in[(row0 + x0) * channels + c])
+                       + float(in[(row0 + x1) * channels + c])
+                       + float(in[(row1 + x0) * channels + c])
+                       + float(in[(row1 + x1) * channels + c]);
+                out[(size_t(y) * outSize.x + x) * channels + c]
+                       = T(sum * .25f + round);
+            }
+        }
+    });
+    data = std::move(outData);
+    size = outSize;
+}
+
+// 8 and 16 bit integer sources keep their precision, anything else loads
+// as float
+static TypeDesc
+_TexelType(ImageSpec const& spec)
+{
+    if (spec.format.size() == 1)
+        return TypeDesc::UINT8;
+    if (spec.format == TypeDesc::UINT16 || spec.format == TypeDesc::INT16)
+        return TypeDesc::UINT16;
+    return TypeDesc::FLOAT;
+}
+
+// channel range [chbegin, chend) of a channel subset like "r" or "rgb",
+// empty for all channels
+static void
+_ChannelRange(std::string const& channelsStr, int channels, int& chbegin,
+              int& chend)
+{
+    chbegin = 0;
+    if (channelsStr == "g")
+        chbegin = 1;
+    if (channelsStr == "b")
+        chbegin = 2;
+    if (channels == 4 && channelsStr == "a")
+        chbegin = 3;
+    chbegin = std::min(chbegin, channels - 1);
+    const int count = channelsStr.empty() ? channels : channelsStr.length();
+    chend = std::min(chbegin + count, channels);
+}
+
+// reads the largest MIP level within maxResolution through an ImageInput
+static bool
+_ReadImageInput(std::string const& file, int maxResolution,
+                std::string const& channelsStr,
+                std::vector<unsigned char>& data, ImageSpec& spec,
+                int& channels)
 {
     auto in = ImageInput::open(file.c_str());
     if (!in) {
         std::cerr << "#osp: failed to load texture '" + file + "'" << std::endl;
-        return std::pair<opp::Texture, unsigned char*>(nullptr, nullptr);
+        return false;
     }
 
-    const ImageSpec& spec = in->spec();
-    vec2i size;
-    size.x = spec.width;
-    size.y = spec.height;
-    int channels = spec.nchannels;
-    const bool hdr = spec.format.size() > 1;
-    int depth = hdr ? 4 : 1;
-    const size_t stride = size.x * channels * depth;
-    unsigned char* data
-           = (unsigned char*)malloc(sizeof(char) * size.y * stride);
-    unsigned char* outData = nullptr; // if using channel subset
-
-    in->read_image(hdr ? TypeDesc::FLOAT : TypeDesc::UINT8, data);
+    int level = 0;
+    spec = in->spec();
+    if (maxResolution > 0) {
+        ImageSpec levelSpec;
+        while (std::max(spec.width, spec.height) > maxResolution
+               && _SeekMipLevel(*in, level + 1, levelSpec)) {
+            spec = levelSpec;
+            level++;
+        }
+        _SeekMipLevel(*in, level, spec);
+    }
+
+    int chbegin, chend;
+    _ChannelRange(channelsStr, spec.nchannels, chbegin, chend);
+    channels = chend - chbegin;
+    const TypeDesc type = _TexelType(spec);
+    const stride_t xstride = channels * type.size();
+    const stride_t ystride = xstride * spec.width;
+    data.resize(ystride * spec.height);
+
+    // write rows bottom up with a negative y stride, because OSPRay's
+    // textures have the origin at the lower left corner
+#if OIIO_VERSION >= 20000
+    unsigned char* lastRow = data.data() + ystride * (spec.height - 1);
+    const bool loaded = in->read_image(0, level, chbegin, chend, type,
+                                       lastRow, xstride, -ystride);
+#else
+    // no channel ranges, read all channels and keep the subset
+    const stride_t allStride = spec.nchannels * type.size();
+    std::vector<unsigned char> allChannels(spec.image_pixels() * allStride);
+    bool loaded = in->read_image(
+           type, allChannels.data() + allStride * spec.image_pixels()
+                        - allStride * spec.width,
+           allStride, -allStride * spec.width);
+    for (size_t i = 0; loaded && i < spec.image_pixels(); i++) {
+        const unsigned char* texel = allChannels.data() + i * allStride
+               + chbegin * type.size();
+        std::copy(texel, texel + xstride, data.data() + i * xstride);
+    }
+#endif
     in->close();
 #if OIIO_VERSION < 10903
     ImageInput::destroy(in);
 #endif
+    if (!loaded)
+        std::cerr << "#osp: failed to load texture '" + file + "'" << std::endl;
+    return loaded;
+}
+
+// a private ImageCache, so its attributes do not change the process wide
+// shared cache of the host application
+static ImageCache*
+_GetImageCache()
+{
+#if OIIO_VERSION >= 30000
+    static std::shared_ptr<ImageCache> imageCache = ImageCache::create(false);
+#else
+    static std::unique_ptr<ImageCache, void (*)(ImageCache*)> imageCache(
+           ImageCache::create(false),
+           [](ImageCache* cache) { ImageCache::destroy(cache); });
+#endif
+    static std::once_flag configured;
+    std::call_once(configured, [] {
+        const HdOSPRayConfig& config = HdOSPRayConfig::GetInstance();
+        if (config.imageCacheSize > 0)
+            imageCache->attribute("max_memory_MB",
+                                  float(config.imageCacheSize));
+        // files without MIP levels get them generated per tile on demand
+        imageCache->attribute("automip", 1);
+    });
+    return imageCache.get();
+}
 
-    const int outChannels
-           = channelsStr.empty() ? channels : channelsStr.length();
-    int outDepth = depth;
-    if (outChannels == 1)
-        outDepth = 4; // convert to float
-    int channelOffset = 0;
-    if (channelsStr == "g")
-        channelOffset = 1;
-    if (channelsStr == "b")
-        channelOffset = 2;
-    if (channels == 4 && channelsStr == "a")
-        channelOffset = 3;
-    if (outChannels != channels || outDepth != depth) {
-        outData = (unsigned char*)malloc(sizeof(char) * size.y * size.x
-                                         * outChannels * outDepth);
+// reads the largest MIP level within maxResolution, whose texels also fit
+// the ImageCache budget, through the ImageCache.  Only the tiles of that
+// level are read, but its texels are copied densely, so the budget bounds
+// the memory of each texture, not of all of them.
+static bool
+_ReadImageCache(std::string const& file, int maxResolution,
+                std::string const& channelsStr,
+                std::vector<unsigned char>& data, ImageSpec& spec,
+                int& channels)
+{
+    ImageCache* imageCache = _GetImageCache();
+    const ustring filename(file);
+    if (!imageCache->get_imagespec(filename, spec)) {
+        std::cerr << "#osp: failed to load texture '" + file + "': "
+                  << imageCache->geterror() << std::endl;
+        return false;
+    }
+
+    int chbegin, chend;
+    _ChannelRange(channelsStr, spec.nchannels, chbegin, chend);
+    channels = chend - chbegin;
+    const TypeDesc type = _TexelType(spec);
+
+    const size_t budget
+           = size_t(HdOSPRayConfig::GetInstance().imageCacheSize) << 20;
+    auto fitsResolution = [&](ImageSpec const& levelSpec) {
+        return maxResolution <= 0
+               || std::max(levelSpec.width, levelSpec.height) <= maxResolution;
+    };
+    auto fitsBudget = [&](ImageSpec const& levelSpec) {
+        return budget == 0
+               || size_t(levelSpec.width) * levelSpec.height * channels
+                                * type.size()
+                        <= budget;
+    };
+    int level = 0;
+    ImageSpec levelSpec;
+    const ImageSpec fullSpec = spec;
+    bool reduced = false;
+    while (!(fitsResolution(spec) && fitsBudget(spec))
+           && imageCache->get_imagespec(filename, levelSpec, 0, level + 1)) {
+        reduced |= fitsResolution(spec);
+        spec = levelSpec;
+        level++;
     }
+    if (reduced || !fitsBudget(spec)) {
+        TF_WARN("Texture '%s' of %dx%d texels exceeds "
+                "HDOSPRAY_IMAGE_CACHE_SIZE, loading %dx%d texels.",
+                file.c_str(), fullSpec.width, fullSpec.height, spec.width,
+                spec.height);
+    }
+
+    const stride_t xstride = channels * type.size();
+    const stride_t ystride = xstride * spec.width;
+    data.resize(ystride * spec.height);
+
+    // flipped like in _ReadImageInput
+    unsigned char* lastRow = data.data() + ystride * (spec.height - 1);
+    if (!imageCache->get_pixels(filename, 0, level, spec.x,
+                                spec.x + spec.width, spec.y,
+                                spec.y + spec.height, spec.z, spec.z + 1,
+                                chbegin, chend, type, lastRow, xstride,
+                                -ystride)) {
+        std::cerr << "#osp: failed to load texture '" + file + "': "
+                  << imageCache->geterror() << std::endl;
+        return false;
+    }
+    return true;
+}
 
-    OSPTextureFormat format = osprayTextureFormat(outDepth, outChannels);
+/// Reads the largest MIP level of \p file within \p maxResolution, 0 for
+/// full resolution, directly into OSPRay's texel layout: flipped, with only
+/// the channels of \p channelsStr and in the precision of the source.
+/// Files without a fitting level are box filtered down.
+static bool
+_ReadOIIOImage(std::string const& file, int maxResolution,
+               std::string const& channelsStr,
+               std::vector<unsigned char>& data, vec2i& size, int& channels,
+               int& depth)
+{
+    ImageSpec spec;
+    const bool loaded = HdOSPRayConfig::GetInstance().textureImageCache
+           ? _ReadImageCache(file, maxResolution, channelsStr, data, spec,
+                             channels)
+           : _ReadImageInput(file, maxResolution, channelsStr, data, spec,
+                             channels);
+    if (!loaded)
+        return false;
 
-    OSPDataType dataType = OSP_UNKNOWN;
-    if (format == OSP_TEXTURE_R32F)
-        dataType = OSP_FLOAT;
-    else if (format == OSP_TEXTURE_RGB32F)
-        dataType = OSP_VEC3F;
-    else if (format == OSP_TEXTURE_RGBA32F)
-        dataType = OSP_VEC4F;
-    else if ((format == OSP_TEXTURE_R8) || (format == OSP_TEXTURE_L8))
-        dataType = OSP_UCHAR;
-    else if ((format == OSP_TEXTURE_RGB8) || (format == OSP_TEXTURE_SRGB))
-        dataType = OSP_VEC3UC;
-    else if (format == OSP_TEXTURE_RGBA8 || format == OSP_TEXTURE_SRGBA)
-        dataType = OSP_VEC4UC;
-    else {
+    size.x = spec.width;
+    size.y = spec.height;
+    depth = _TexelType(spec).size();
+
+    while (maxResolution > 0 && std::max(size.x, size.y) > maxResolution) {
+        if (depth == 4)
+            _BoxDownsample<float>(data, size, channels);
+        else if (depth == 2)
+            _BoxDownsample<uint16_t>(data, size, channels);
+        else
+            _BoxDownsample<unsigned char>(data, size, channels);
+    }
+    return true;
+}
+
+bool
+LoadOIIOTexels(std::string file, HdOSPRayTexels& texels,
+               std::string channelsStr, bool complement, int maxResolution)
+{
+    vec2i size;
+    int channels, depth;
+    if (!_ReadOIIOImage(file, maxResolution, channelsStr, texels.data, size,
+                        channels, depth))
+        return false;
+
+    // single channels are data maps like roughness and stay linear
+    OSPTextureFormat format
+           = osprayTextureFormat(depth, channels, channels == 1);
+    OSPDataType dataType = _TextureDataType(format);
+    if (dataType == OSP_UNKNOWN) {
         std::cout << "Texture: file: " << file << "\tdepth: " << depth
                   << "\tchannels: " << channels << "\format: " << format
                   << std::endl;
         throw std::runtime_error(
-               "hdOSPRay::LoadOIIOTexture2D: \
+               "hdOSPRay::LoadOIIOTexels: \
                                          Unknown texture format");
     }
 
-    // flip image (because OSPRay's textures have the origin at the lower left
-    // corner)
     // compute complement if enabled
-    for (int y = 0; y < size.y / 2; y++) {
-        unsigned char* src = &data[y * stride];
-        unsigned char* dest = &data[(size.y - 1 - y) * stride];
-        for (size_t x = 0; x < stride; x++)
-            std::swap(src[x], dest[x]);
-    }
-    if (complement && (format == OSP_TEXTURE_R32F)) {
-        float* tex = (float*)data;
-        for (size_t i = 0; i < size.x * size.y; i++)
-            tex[i] = 1.f - tex[i];
-    }
-    // convert to outchannels if needed.
-    // supported:
-    // rgba, rgba to: rgb, r, g, b, or a
-    if (outData) {
-        const size_t outStride = size.x * outChannels * outDepth;
-        const size_t offsetBytes = channelOffset * depth;
-        const size_t inBytes = depth * channels;
-        const size_t outBytes = outDepth * outChannels;
-        unsigned char* in = (unsigned char*)data + offsetBytes;
-        unsigned char* out = outData;
-        for (size_t i = 0; i < size.x * size.y; i++) {
-            if (outDepth == depth)
-                std::copy(in, in + outBytes, out);
-            else { // assume conversion to float
-                float* vals = (float*)out;
-                for (int j = 0; j < outChannels; j++)
-                    vals[j] = float(in[j]) / 256.f;
-            }
-            in += inBytes;
-            out += outBytes;
-        }
-    }
+    if (complement)
+        _Complement(texels.data, depth);
 
-    opp::SharedData ospData
-           = opp::SharedData(outData ? outData : data, dataType, size);
-    ospData.commit();
+    texels.size = size;
+    texels.format = format;
+    texels.dataType = dataType;
+    return true;
+}
 
-    opp::Texture ospTexture = opp::Texture("texture2d");
-    ospTexture.setParam("format", format);
-    ospTexture.setParam("filter",
-                        nearestFilter ? OSP_TEXTURE_FILTER_NEAREST
-                                      : OSP_TEXTURE_FILTER_BILINEAR);
-    ospTexture.setParam("data", ospData);
-    ospTexture.commit();
+void
+SetOSPTextureData(opp::Texture& texture, HdOSPRayTexels const& texels,
+                  bool nearestFilter)
+{
+    opp::SharedData ospData = opp::SharedData(texels.GetData(),
+                                              texels.dataType, texels.size);
+    ospData.commit();
 
-    return std::pair<opp::Texture, unsigned char*>(ospTexture, data);
+    texture.setParam("format", texels.format);
+    texture.setParam("filter",
+                     nearestFilter ? OSP_TEXTURE_FILTER_NEAREST
+                                   : OSP_TEXTURE_FILTER_BILINEAR);
+    texture.setParam("data", ospData);
 }
 
 struct UDIMTileDesc {
-    char* data { nullptr };
+    std::vector<unsigned char> data;
     vec2i size { 0, 0 };
     int offset { -1 };
+    int depth { 0 };
+    int channels { 0 };
 };
 
 /// UDIM helper, splits udim filepath into individual tile files
 /// @param filePath Udim filepath of form ...<UDIM>...
-/// @result computes pairs of form <tile id, texture file>
-static std::vector<std::tuple<int, TfToken>>
+/// @result computes pairs of form <tile id, texture file>, sorted by id
+static std::vector<std::tuple<int, std::string>>
 _ParseUDIMTiles(const std::string& filePath)
 {
-    std::vector<std::tuple<int, TfToken>> result;
+    std::vector<std::tuple<int, std::string>> result;
 
     // split filesnames to get prefix and suffix of form ....<UDIM>...
     auto splitPath = std::make_pair(std::string(), std::string());
@@ -199,6 +466,32 @@ _ParseUDIMTiles(const std::string& filePath)
         return result;
     }
 
+    // list the directory once instead of resolving every candidate tile
+    const std::string dir = TfGetPathName(splitPath.first);
+    const std::string prefix = splitPath.first.substr(dir.size());
+    const std::string& suffix = splitPath.second;
+    std::vector<std::string> dirNames, fileNames, linkNames;
+    if (suffix.find('/') == std::string::npos
+        && TfReadDir(dir.empty() ? "." : dir, &dirNames, &fileNames,
+                     &linkNames)) {
+        fileNames.insert(fileNames.end(), linkNames.begin(), linkNames.end());
+        for (const auto& name : fileNames) {
+            if (name.size() != prefix.size() + 4 + suffix.size()
+                || !TfStringStartsWith(name, prefix)
+                || !TfStringEndsWith(name, suffix))
+                continue;
+            const std::string number = name.substr(prefix.size(), 4);
+            if (!std::all_of(number.begin(), number.end(), ::isdigit))
+                continue;
+            const int id = std::stoi(number);
+            if (id > 1000 && id < 2000)
+                result.emplace_back(id - 1001, dir + name);
+        }
+        std::sort(result.begin(), result.end());
+        return result;
+    }
+
+    // not a file system path, probe the tiles through the resolver
     ArResolver& resolver = ArGetResolver();
 
     // add file names to result
@@ -213,148 +506,495 @@ _ParseUDIMTiles(const std::string& filePath)
     return result;
 }
 
-// creates 2d osptexture from file, does not commit
-std::pair<opp::Texture, char*>
-LoadUDIMTexture2D(std::string file, int& numX, int& numY, bool nearestFilter,
-                  bool complement)
+// bounding box of the tiles returned by _ParseUDIMTiles
+static HdOSPRayUDIMLayout
+_ComputeUDIMLayout(std::vector<std::tuple<int, std::string>> const& udimTiles)
 {
-    auto udimTiles = _ParseUDIMTiles(file);
-    std::vector<UDIMTileDesc> udimTileDescs;
-    vec2i totalSize { 0, 0 };
-    vec2i numTiles { 0, 0 };
-    numTiles = { 0, 0 };
-    OSPDataType udimDataType = OSP_UNKNOWN;
-    size_t dataStride = 0;
-    size_t texelSize = 0;
-    OSPTextureFormat format = OSP_TEXTURE_FORMAT_INVALID;
-
-    // load tile data  TODO: parallelize
-    for (auto tile : udimTiles) {
-        std::string file = std::get<1>(tile);
-        auto in = ImageInput::open(file.c_str());
-        if (!in) {
-            std::cerr << "#osp: failed to load texture '" + file + "'"
-                      << std::endl;
-            return std::pair<opp::Texture, char*>(nullptr, nullptr);
-        }
+    HdOSPRayUDIMLayout layout;
+    if (udimTiles.empty())
+        return layout;
+
+    int lastX = 0, lastY = 0;
+    layout.firstX = layout.firstY = std::numeric_limits<int>::max();
+    for (const auto& tile : udimTiles) {
+        const int offset = std::get<0>(tile);
+        layout.firstX = std::min(layout.firstX, offset % 10);
+        layout.firstY = std::min(layout.firstY, offset / 10);
+        lastX = std::max(lastX, offset % 10);
+        lastY = std::max(lastY, offset / 10);
+    }
+    layout.numX = lastX - layout.firstX + 1;
+    layout.numY = lastY - layout.firstY + 1;
+    return layout;
+}
 
-        const ImageSpec& spec = in->spec();
-        vec2i size;
-        size.x = spec.width;
-        size.y = spec.height;
-        int channels = spec.nchannels;
-        const bool hdr = spec.format.size() > 1;
-        int depth = hdr ? 4 : 1;
-        int texelSizeCurrent = channels * depth;
-        if ((texelSize != 0) && (texelSize != texelSizeCurrent)) {
-            std::cerr << "UDIM::texel sizes do not match\n";
-            // TODO: cleanup mem
-            return std::pair<opp::Texture, char*>(nullptr, nullptr);
-        }
-        texelSize = texelSizeCurrent;
-        const size_t stride = size.x * channels * depth;
-        const size_t dataSize = sizeof(char) * size.y * stride;
-        char* data = (char*)malloc(dataSize);
-        dataStride = stride;
-
-        in->read_image(hdr ? TypeDesc::FLOAT : TypeDesc::UINT8, data);
-        in->close();
-#if OIIO_VERSION < 10903
-        ImageInput::destroy(in);
-#endif
+void
+GetUDIMTileLayout(std::string file, HdOSPRayUDIMLayout& layout)
+{
+    layout = _ComputeUDIMLayout(_ParseUDIMTiles(file));
+}
 
-        // flip image (because OSPRay's textures have the origin at the lower
-        // left corner)
-        for (int y = 0; y < size.y / 2; y++) {
-            char* src = &data[y * stride];
-            char* dest = &data[(size.y - 1 - y) * stride];
-            for (size_t x = 0; x < stride; x++)
-                std::swap(src[x], dest[x]);
-        }
-        format = osprayTextureFormat(depth, channels);
-
-        OSPDataType dataType = OSP_UNKNOWN;
-        if (format == OSP_TEXTURE_R32F) {
-            dataType = OSP_FLOAT;
-        } else if (format == OSP_TEXTURE_RGB32F) {
-            dataType = OSP_VEC3F;
-        } else if (format == OSP_TEXTURE_RGBA32F) {
-            dataType = OSP_VEC4F;
-        } else if ((format == OSP_TEXTURE_R8) || (format == OSP_TEXTURE_L8)) {
-            dataType = OSP_UCHAR;
-        } else if ((format == OSP_TEXTURE_RGB8)
-                   || (format == OSP_TEXTURE_SRGB)) {
-            dataType = OSP_VEC3UC;
-        } else if (format == OSP_TEXTURE_RGBA8 || format == OSP_TEXTURE_SRGBA) {
-            dataType = OSP_VEC4UC;
-        } else {
-            std::cout << "Texture: file: " << file << "\tdepth: " << depth
-                      << "\tchannels: " << channels << "\format: " << format
-                      << std::endl;
-            throw std::runtime_error(
-                   "hdOSPRay::texture::LoadTexture2D: \
+bool
+LoadUDIMTexels(std::string file, HdOSPRayTexels& texels, bool complement,
+               int maxResolution, HdOSPRayUDIMLayout const* layout)
+{
+    // the atlas and the tile offsets use one listing of the tiles, or the
+    // layout the caller already derived its texture transform from
+    auto udimTiles = _ParseUDIMTiles(file);
+    const HdOSPRayUDIMLayout udimLayout
+           = layout ? *layout : _ComputeUDIMLayout(udimTiles);
+    udimTiles.erase(
+           std::remove_if(udimTiles.begin(), udimTiles.end(),
+                          [&udimLayout](std::tuple<int, std::string> const& t) {
+                              return !udimLayout.Contains(std::get<0>(t));
+                          }),
+           udimTiles.end());
+    if (udimTiles.empty()) {
+        TF_WARN("No UDIM tiles found for '%s'.", file.c_str());
+        return false;
+    }
+
+    // decode all tiles in parallel
+    std::vector<UDIMTileDesc> udimTileDescs(udimTiles.size());
+    std::atomic<bool> failed { false };
+    tbb::parallel_for(size_t(0), udimTiles.size(), [&](size_t i) {
+        udimTileDescs[i].offset = std::get<0>(udimTiles[i]);
+        UDIMTileDesc& desc = udimTileDescs[i];
+        if (!_ReadOIIOImage(std::get<1>(udimTiles[i]), maxResolution, "",
+                            desc.data, desc.size, desc.channels, desc.depth))
+            failed = true;
+    });
+    if (failed)
+        return false;
+
+    const UDIMTileDesc& first = udimTileDescs.front();
+    const OSPTextureFormat format = osprayTextureFormat(
+           first.depth, first.channels, first.channels == 1);
+    const OSPDataType udimDataType = _TextureDataType(format);
+    if (udimDataType == OSP_UNKNOWN) {
+        std::cout << "Texture: file: " << file << "\tdepth: " << first.depth
+                  << "\tchannels: " << first.channels << "\format: " << format
+                  << std::endl;
+        throw std::runtime_error(
+               "hdOSPRay::texture::LoadUDIMTexels: \
                                          Unknown texture format");
-        }
-        if ((udimDataType != OSP_UNKNOWN) && udimDataType != dataType) {
+    }
+
+    // cells of the atlas fit the largest tile, the atlas only spans the
+    // bounding box of the existing tiles
+    vec2i cellSize { 0, 0 };
+    for (const auto& tile : udimTileDescs) {
+        if (tile.depth != first.depth || tile.channels != first.channels) {
             std::cerr << "UDIM has inconsisntent data types\n";
-            delete data;
-            return std::pair<opp::Texture, char*>(nullptr, nullptr);
+            return false;
         }
-        udimDataType = dataType;
-
-        UDIMTileDesc desc;
-        desc.size = size;
-        desc.data = data;
-        desc.offset = std::get<0>(tile);
-        int tileX = ((desc.offset % 10) + 1);
-        int tileY = (desc.offset / 10 + 1);
-        int totalX = size.x * tileX;
-        int totalY = size.y * tileY;
-        numTiles.x = std::max(numTiles.x, tileX);
-        numTiles.y = std::max(numTiles.y, tileY);
-        totalSize.x = std::max(totalSize.x, totalX);
-        totalSize.y = std::max(totalSize.y, totalY);
-        udimTileDescs.emplace_back(desc);
+        cellSize.x = std::max(cellSize.x, tile.size.x);
+        cellSize.y = std::max(cellSize.y, tile.size.y);
     }
-
-    numX = numTiles.x;
-    numY = numTiles.y;
-    size_t dataSize = totalSize.x * totalSize.y * texelSize;
-    char* data = (char*)malloc(sizeof(char) * dataSize);
-
-    // copy tile to main texture
-    for (auto tile : udimTileDescs) {
+    const vec2i totalSize { cellSize.x * udimLayout.numX,
+                            cellSize.y * udimLayout.numY };
+    const size_t texelSize = first.depth * first.channels;
+
+    size_t dataSize = size_t(totalSize.x) * totalSize.y * texelSize;
+    texels.data.assign(dataSize, 0);
+    unsigned char* data = texels.data.data();
+
+    // copy tiles to main texture, each tile covers a disjoint cell
+    tbb::parallel_for(size_t(0), udimTileDescs.size(), [&](size_t i) {
+        UDIMTileDesc& tile = udimTileDescs[i];
+        if (complement)
+            _Complement(tile.data, tile.depth);
         vec2i startTexels;
-        startTexels.x = tile.size.x * (tile.offset % 10);
-        startTexels.y = tile.size.y * (tile.offset / 10);
-        size_t dataIndex = startTexels.y * totalSize.x + startTexels.x;
-        size_t tileIndex = 0;
+        startTexels.x = cellSize.x * (tile.offset % 10 - udimLayout.firstX);
+        startTexels.y = cellSize.y * (tile.offset / 10 - udimLayout.firstY);
+        size_t dataIndex = size_t(startTexels.y) * totalSize.x + startTexels.x;
+        const size_t rowBytes = tile.size.x * texelSize;
         for (int y = 0; y < tile.size.y; y++) {
-            size_t start = tileIndex * texelSize;
-            size_t end = (tileIndex + tile.size.x) * texelSize;
-            if (complement && (udimDataType == OSP_FLOAT)) {
-                float* tex = (float*)(tile.data + start);
-                for (int i = 0; i < tile.size.x; i++)
-                    tex[i] = 1.f - tex[i];
-            }
-            std::copy(tile.data + start, tile.data + end,
-                      data + dataIndex * texelSize);
-            tileIndex += tile.size.x;
+            const unsigned char* row = tile.data.data() + y * rowBytes;
+            std::copy(row, row + rowBytes, data + dataIndex * texelSize);
             dataIndex += totalSize.x;
         }
+    });
+
+    texels.size = totalSize;
+    texels.format = format;
+    texels.dataType = udimDataType;
+    texels.udimLayout = udimLayout;
+    return true;
+}
+
+// bump whenever the decoded texel layout changes
+static const uint32_t _diskCacheVersion = 2;
+
+struct _DiskCacheHeader {
+    char magic[4];
+    uint32_t version;
+    uint32_t keyLength;
+    int32_t sizeX;
+    int32_t sizeY;
+    int32_t format;
+    int32_t dataType;
+    // HdOSPRayUDIMLayout of atlases
+    int32_t udimFirstX;
+    int32_t udimFirstY;
+    int32_t udimNumX;
+    int32_t udimNumY;
+    uint64_t numBytes;
+};
+
+// texels start 64 byte aligned after the header and key
+static size_t
+_DiskCacheDataOffset(size_t keyLength)
+{
+    return (sizeof(_DiskCacheHeader) + keyLength + 63) & ~size_t(63);
+}
+
+/// Returns the path of the on-disk cache entry of \p key in \p cacheKey
+/// and the entry, or an empty path if the file cannot be cached.  The
+/// key contains the modification time and size of the file, so edited
+/// files miss the cache, and the ImageCache budget when the file is read
+/// through it, as the budget limits the loaded resolution.
+static std::string
+_DiskCachePath(HdOSPRayTextureKey const& key, std::string& cacheKey)
+{
+    const HdOSPRayConfig& config = HdOSPRayConfig::GetInstance();
+    const std::string& dir = config.textureDiskCache;
+    if (dir.empty())
+        return std::string();
+
+    double modificationTime = 0.0;
+    const int64_t fileSize = ArchGetFileLength(key.file.c_str());
+    if (fileSize < 0 || !ArchGetModificationTime(key.file, &modificationTime))
+        return std::string();
+
+    // -1 for files decoded without the ImageCache
+    const long long imageCacheSize
+           = config.textureImageCache ? config.imageCacheSize : -1;
+    cacheKey = TfStringPrintf("%s|%s|%d|%d|%lld|%.6f|%lld", key.file.c_str(),
+                              key.channels.c_str(), int(key.complement),
+                              key.maxResolution, imageCacheSize,
+                              modificationTime, (long long)fileSize);
+    return TfStringPrintf("%s/%016zx.ospt", dir.c_str(),
+                          std::hash<std::string>()(cacheKey));
+}
+
+// maps the texels of a cache entry, returns false on a miss
+static bool
+_ReadDiskCache(std::string const& path, std::string const& cacheKey,
+               HdOSPRayTexels& texels)
+{
+    if (!TfIsFile(path))
+        return false;
+    ArchConstFileMapping mapping = ArchMapFileReadOnly(path);
+    if (!mapping)
+        return false;
+    const size_t length = ArchGetFileMappingLength(mapping);
+    if (length < sizeof(_DiskCacheHeader))
+        return false;
+
+    _DiskCacheHeader header;
+    std::memcpy(&header, mapping.get(), sizeof(header));
+    const size_t offset = _DiskCacheDataOffset(header.keyLength);
+    if (std::strncmp(header.magic, "OSPT", 4) != 0
+        || header.version != _diskCacheVersion
+        || header.keyLength != cacheKey.size()
+        || length < offset + header.numBytes
+        || cacheKey.compare(0, cacheKey.size(),
+                            mapping.get() + sizeof(header), header.keyLength)
+               != 0)
+        return false;
+
+    texels.data.clear();
+    texels.mapping = std::move(mapping);
+    texels.mappingOffset = offset;
+    texels.mappingSize = header.numBytes;
+    texels.size = vec2i(header.sizeX, header.sizeY);
+    texels.format = OSPTextureFormat(header.format);
+    texels.dataType = OSPDataType(header.dataType);
+    texels.udimLayout.firstX = header.udimFirstX;
+    texels.udimLayout.firstY = header.udimFirstY;
+    texels.udimLayout.numX = header.udimNumX;
+    texels.udimLayout.numY = header.udimNumY;
+    return true;
+}
+
+// writes a cache entry, replacing the file atomically
+static void
+_WriteDiskCache(std::string const& path, std::string const& cacheKey,
+                HdOSPRayTexels const& texels)
+{
+    const std::string dir = TfGetPathName(path);
+    if (!TfIsDir(dir) && !TfMakeDirs(dir)) {
+        TF_WARN("Cannot create texture cache directory '%s'.", dir.c_str());
+        return;
     }
 
-    // create ospray texture object from data
-    opp::SharedData ospData = opp::SharedData(data, udimDataType, totalSize);
-    ospData.commit();
+    TfAtomicOfstreamWrapper wrapper(path);
+    std::string reason;
+    if (!wrapper.Open(&reason)) {
+        TF_WARN("Cannot write texture cache '%s': %s", path.c_str(),
+                reason.c_str());
+        return;
+    }
 
-    opp::Texture ospTexture = opp::Texture("texture2d");
-    ospTexture.setParam("format", format);
-    ospTexture.setParam("filter",
-                        nearestFilter ? OSP_TEXTURE_FILTER_NEAREST
-                                      : OSP_TEXTURE_FILTER_BILINEAR);
-    ospTexture.setParam("data", ospData);
-    ospTexture.commit();
+    _DiskCacheHeader header {};
+    std::memcpy(header.magic, "OSPT", 4);
+    header.version = _diskCacheVersion;
+    header.keyLength = cacheKey.size();
+    header.sizeX = texels.size.x;
+    header.sizeY = texels.size.y;
+    header.format = texels.format;
+    header.dataType = texels.dataType;
+    header.udimFirstX = texels.udimLayout.firstX;
+    header.udimFirstY = texels.udimLayout.firstY;
+    header.udimNumX = texels.udimLayout.numX;
+    header.udimNumY = texels.udimLayout.numY;
+    header.numBytes = texels.GetSize();
+    const std::string padding(_DiskCacheDataOffset(cacheKey.size())
+                                     - sizeof(header) - cacheKey.size(),
+                              '\0');
+
+    std::ostream& out = wrapper.GetStream();
+    out.write((const char*)&header, sizeof(header));
+    out << cacheKey << padding;
+    out.write((const char*)texels.GetData(), texels.GetSize());
+    if (!out || !wrapper.Commit(&reason))
+        TF_WARN("Cannot write texture cache '%s': %s", path.c_str(),
+                reason.c_str());
+}
+
+size_t
+HdOSPRayTextureKey::Hash::operator()(HdOSPRayTextureKey const& key) const
+{
+    size_t hash = std::hash<std::string>()(key.file);
+    hash ^= std::hash<std::string>()(key.channels) + 0x9e3779b9 + (hash << 6)
+           + (hash >> 2);
+    hash ^= std::hash<int>()(key.maxResolution) + 0x9e3779b9 + (hash << 6)
+           + (hash >> 2);
+    return hash ^ (size_t(key.complement) << 1) ^ size_t(key.nearestFilter);
+}
+
+HdOSPRayTextureCache::~HdOSPRayTextureCache()
+{
+    _loadArena.execute([this] { _loadTasks.wait(); });
+}
+
+HdOSPRayCachedTexturePtr
+HdOSPRayTextureCache::GetTexture(HdOSPRayTextureKey const& key, bool async)
+{
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        auto it = _textures.find(key);
+        if (it != _textures.end()) {
+            it->second.lastUse = ++_useCounter;
+            return it->second.texture;
+        }
 
-    return std::pair<opp::Texture, char*>(ospTexture, data);
-}
\ No newline at end of file
+        // failed background loads are retried once the file changed
+        auto failed = _failedLoads.find(key);
+        if (failed != _failedLoads.end()) {
+            double modificationTime = 0.0;
+            ArchGetModificationTime(key.file, &modificationTime);
+            if (modificationTime == failed->second)
+                return nullptr;
+            _failedLoads.erase(failed);
+        }
+    }
+
+    async &= HdOSPRayConfig::GetInstance().asyncTextureLoading;
+
+    // missing files get no placeholder, as in synchronous loads
+    if (async && !TfStringContains(key.file, "<UDIM>")
+        && !TfIsFile(key.file, true))
+        return nullptr;
+
+    // load outside of the lock so different textures load concurrently
+    _TexturePtr texture
+           = async ? _CreatePlaceholder(key) : _LoadTexture(key);
+    if (!texture)
+        return nullptr;
+
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _Entry& entry = _textures[key];
+        entry.lastUse = ++_useCounter;
+        if (entry.texture)
+            return entry.texture; // loaded concurrently by another material
+        entry.texture = texture;
+        _memoryUsage += texture->texels.GetSize();
+    }
+
+    if (async) {
+        // decode on a dedicated arena, so the render thread does not pick
+        // up load tasks while waiting on its own parallel work
+        _numLoading++;
+        const HdOSPRayUDIMLayout udimLayout = texture->texels.udimLayout;
+        _loadArena.execute([&] {
+            _loadTasks.run([this, key, texture, udimLayout] {
+                _LoadedTexture loaded;
+                bool decoded = false;
+                try {
+                    decoded = _DecodeTexels(key, loaded.texels, &udimLayout);
+                } catch (std::exception const& e) {
+                    std::cerr << "#osp: failed to load texture '" << key.file
+                              << "': " << e.what() << std::endl;
+                }
+                {
+                    std::lock_guard<std::mutex> lock(_mutex);
+                    if (decoded) {
+                        loaded.texture = texture;
+                        loaded.nearestFilter = key.nearestFilter;
+                        _loaded.emplace_back(std::move(loaded));
+                    } else
+                        _failed.push_back({ key, texture });
+                }
+                _numLoading--;
+            });
+        });
+    }
+    return texture;
+}
+
+bool
+HdOSPRayTextureCache::CommitLoadedTextures(bool& failed)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    failed = !_failed.empty();
+    if (_loaded.empty() && _failed.empty())
+        return false;
+
+    // failed textures are dropped, unless the entry was replaced meanwhile
+    for (auto const& failedTexture : _failed) {
+        auto it = _textures.find(failedTexture.key);
+        if (it != _textures.end()
+            && it->second.texture == failedTexture.texture) {
+            _memoryUsage -= it->second.texture->texels.GetSize();
+            _textures.erase(it);
+        }
+        double modificationTime = 0.0;
+        ArchGetModificationTime(failedTexture.key.file, &modificationTime);
+        _failedLoads[failedTexture.key] = modificationTime;
+    }
+    _failed.clear();
+
+    for (auto& loaded : _loaded) {
+        HdOSPRayCachedTexture& texture = *loaded.texture;
+        // the placeholder texels have to outlive the commit of the new data
+        HdOSPRayTexels placeholder = std::move(texture.texels);
+        texture.texels = std::move(loaded.texels);
+        SetOSPTextureData(texture.ospTexture, texture.texels,
+                          loaded.nearestFilter);
+        texture.ospTexture.commit();
+        _memoryUsage += texture.texels.GetSize();
+        _memoryUsage -= placeholder.GetSize();
+    }
+    _loaded.clear();
+    return true;
+}
+
+bool
+HdOSPRayTextureCache::HasPendingLoads() const
+{
+    if (_numLoading > 0)
+        return true;
+    std::lock_guard<std::mutex> lock(_mutex);
+    return !_loaded.empty() || !_failed.empty();
+}
+
+void
+HdOSPRayTextureCache::Trim()
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    _Trim();
+}
+
+void
+HdOSPRayTextureCache::_Trim()
+{
+    const size_t budget
+           = size_t(HdOSPRayConfig::GetInstance().textureCacheSize) << 20;
+    if (_memoryUsage <= budget)
+        return;
+
+    // textures only referenced by the cache are unused
+    std::vector<std::pair<size_t, HdOSPRayTextureKey>> unused;
+    for (const auto& [key, entry] : _textures) {
+        if (entry.texture.use_count() == 1)
+            unused.emplace_back(entry.lastUse, key);
+    }
+    std::sort(unused.begin(), unused.end(),
+              [](const auto& a, const auto& b) { return a.first < b.first; });
+
+    for (const auto& lru : unused) {
+        if (_memoryUsage <= budget)
+            break;
+        auto it = _textures.find(lru.second);
+        _memoryUsage -= it->second.texture->texels.GetSize();
+        _textures.erase(it);
+    }
+}
+
+bool
+HdOSPRayTextureCache::_DecodeTexels(HdOSPRayTextureKey const& key,
+                                    HdOSPRayTexels& texels,
+                                    HdOSPRayUDIMLayout const* udimLayout)
+{
+    if (TfStringContains(key.file, "<UDIM>"))
+        return LoadUDIMTexels(key.file, texels, key.complement,
+                              key.maxResolution, udimLayout);
+
+    std::string cacheKey;
+    const std::string cachePath = _DiskCachePath(key, cacheKey);
+    if (!cachePath.empty() && _ReadDiskCache(cachePath, cacheKey, texels))
+        return true;
+
+    if (!LoadOIIOTexels(key.file, texels, key.channels, key.complement,
+                        key.maxResolution))
+        return false;
+    if (!cachePath.empty())
+        _WriteDiskCache(cachePath, cacheKey, texels);
+    return true;
+}
+
+HdOSPRayTextureCache::_TexturePtr
+HdOSPRayTextureCache::_LoadTexture(HdOSPRayTextureKey const& key)
+{
+    auto texture = std::make_shared<HdOSPRayCachedTexture>();
+    if (!_DecodeTexels(key, texture->texels))
+        return nullptr;
+
+    texture->ospTexture = opp::Texture("texture2d");
+    SetOSPTextureData(texture->ospTexture, texture->texels,
+                      key.nearestFilter);
+    texture->ospTexture.commit();
+    return texture;
+}
+
+HdOSPRayTextureCache::_TexturePtr
+HdOSPRayTextureCache::_CreatePlaceholder(HdOSPRayTextureKey const& key)
+{
+    auto texture = std::make_shared<HdOSPRayCachedTexture>();
+    HdOSPRayTexels& texels = texture->texels;
+    // the tile layout is needed right away for the material transforms, the
+    // atlas is decoded into it
+    if (TfStringContains(key.file, "<UDIM>"))
+        GetUDIMTileLayout(key.file, texels.udimLayout);
+
+    // a single texel: opacity is complemented to transmission and starts
+    // out opaque
+    texels.size = vec2i(1, 1);
+    if (key.channels.length() == 1) {
+        texels.data = { (unsigned char)(key.complement ? 0 : 128) };
+        texels.format = OSP_TEXTURE_R8;
+        texels.dataType = OSP_UCHAR;
+    } else {
+        texels.data = { 128, 128, 128, 255 };
+        texels.format = OSP_TEXTURE_RGBA8;
+        texels.dataType = OSP_VEC4UC;
+    }
+
+    texture->ospTexture = opp::Texture("texture2d");
+    SetOSPTextureData(texture->ospTexture, texels, key.nearestFilter);
+    texture->ospTexture.commit();
+    return texture;
+}
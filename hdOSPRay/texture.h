@@ -3,6 +3,7 @@
 
 #pragma once
 
+#include <pxr/base/arch/fileSystem.h>
 #include <pxr/pxr.h>
 
 #include <ospray/ospray_cpp.h>
@@ -10,7 +11,15 @@
 
 namespace opp = ospray::cpp;
 
+#include <tbb/task_arena.h>
+#include <tbb/task_group.h>
+
+#include <atomic>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <unordered_map>
+#include <vector>
 
 PXR_NAMESPACE_USING_DIRECTIVE
 
@@ -19,23 +28,223 @@ OSPTextureFormat osprayTextureFormat(int depth, int channels,
 
 opp::Texture LoadPtexTexture(std::string file);
 
-/// @brief  Load OIIO Texture
+/// \struct HdOSPRayUDIMLayout
+///
+/// Bounding box of the tiles of a UDIM set, in tile columns and rows.  A
+/// texture atlas of the set has one cell per tile of the box.
+///
+struct HdOSPRayUDIMLayout {
+    int firstX { 0 };
+    int firstY { 0 };
+    int numX { 1 };
+    int numY { 1 };
+
+    /// whether the tile with index \p offset, i.e. UDIM number - 1001, lies
+    /// within the box
+    bool Contains(int offset) const
+    {
+        return offset % 10 >= firstX && offset % 10 < firstX + numX
+               && offset / 10 >= firstY && offset / 10 < firstY + numY;
+    }
+};
+
+/// \struct HdOSPRayTexels
+///
+/// Decoded texel data of a 2d texture, in the layout OSPRay expects.  The
+/// texels are either held in data or mapped from the on-disk texture cache.
+///
+struct HdOSPRayTexels {
+    std::vector<unsigned char> data;
+    /// mapped file holding the texels at mappingOffset, instead of data
+    ArchConstFileMapping mapping;
+    size_t mappingOffset { 0 };
+    size_t mappingSize { 0 };
+    rkcommon::math::vec2i size { 0, 0 };
+    OSPTextureFormat format { OSP_TEXTURE_FORMAT_INVALID };
+    OSPDataType dataType { OSP_UNKNOWN };
+    /// tile layout of UDIM atlases, a single tile for regular textures
+    HdOSPRayUDIMLayout udimLayout;
+
+    const unsigned char* GetData() const
+    {
+        if (mapping)
+            return (const unsigned char*)mapping.get() + mappingOffset;
+        return data.data();
+    }
+
+    size_t GetSize() const
+    {
+        return mapping ? mappingSize : data.size();
+    }
+};
+
+/// @brief  Decode OIIO Texture.  Does not call into OSPRay, so it can run
+/// on any thread.
+/// @param filename
+/// @param texels output
+/// @param channels subset, e.g. "r", empty for all
+/// @param compute 1-val in the precision of the texels
+/// @param maxResolution largest width or height to load, 0 for full
+/// resolution.  Uses MIP levels of the file if present.
+/// @return false if the file could not be loaded
+bool LoadOIIOTexels(std::string file, HdOSPRayTexels& texels,
+                    std::string channels = "", bool complement = false,
+                    int maxResolution = 0);
+
+/// @brief  Bounding box of the existing tiles of a UDIM set.  Tiles are
+/// discovered by listing their directory.
 /// @param filename
-/// @param nearestFilter or interpolation
-/// @param compute 1.f-val.  float only.
-/// @return OSPRay texture object, data pointer
-std::pair<opp::Texture, unsigned char*>
-LoadOIIOTexture2D(std::string file, std::string channels = "",
-                  bool nearestFilter = false, bool complement = false);
-
-/// @brief
+/// @param layout output
+void GetUDIMTileLayout(std::string file, HdOSPRayUDIMLayout& layout);
+
+/// @brief  Decode UDIM tiles in parallel into one atlas spanning the tile
+/// layout, which is stored in texels.udimLayout.  Does not call into OSPRay,
+/// so it can run on any thread.
 /// @param filename
-/// @param number of udim tile columns
-/// @param number of udim tile rows
+/// @param texels output
+/// @param compute 1-val in the precision of the texels
+/// @param maxResolution largest width or height to load per tile, 0 for
+/// full resolution
+/// @param layout of the atlas, tiles outside of it are skipped.  Null for
+/// the bounding box of the tiles found.
+/// @return false if a tile could not be loaded
+bool LoadUDIMTexels(std::string file, HdOSPRayTexels& texels,
+                    bool complement = false, int maxResolution = 0,
+                    HdOSPRayUDIMLayout const* layout = nullptr);
+
+/// @brief  Sets format, filter and data of a texture2d.  The texels are
+/// shared, not copied, and have to outlive the texture.  Does not commit the
+/// texture.
+/// @param texture
+/// @param texels
 /// @param use nearestFilter or interpolation
-/// @param compute 1.f-val.  float only.
-/// @return OSPRay texture object, data pointer
-std::pair<opp::Texture, char*> LoadUDIMTexture2D(std::string file, int& numX,
-                                                 int& numY,
-                                                 bool nearestFilter = false,
-                                                 bool complement = false);
\ No newline at end of file
+void SetOSPTextureData(opp::Texture& texture, HdOSPRayTexels const& texels,
+                       bool nearestFilter = false);
+
+/// \struct HdOSPRayTextureKey
+///
+/// Identifies a loaded texture in the HdOSPRayTextureCache
+///
+struct HdOSPRayTextureKey {
+    /// resolved file path, UDIM sets contain <UDIM>
+    std::string file;
+    /// channel subset, e.g. "r", empty for all channels
+    std::string channels;
+    /// compute 1.f-val
+    bool complement { false };
+    bool nearestFilter { false };
+    /// largest width or height to load, 0 for full resolution
+    int maxResolution { 0 };
+
+    bool operator==(HdOSPRayTextureKey const& other) const
+    {
+        return file == other.file && channels == other.channels
+               && complement == other.complement
+               && nearestFilter == other.nearestFilter
+               && maxResolution == other.maxResolution;
+    }
+
+    struct Hash {
+        size_t operator()(HdOSPRayTextureKey const& key) const;
+    };
+};
+
+/// \struct HdOSPRayCachedTexture
+///
+/// A committed texture shared through the HdOSPRayTextureCache, together
+/// with the texel memory it references
+///
+struct HdOSPRayCachedTexture {
+    opp::Texture ospTexture { nullptr };
+    HdOSPRayTexels texels;
+};
+
+using HdOSPRayCachedTexturePtr = std::shared_ptr<const HdOSPRayCachedTexture>;
+
+/// \class HdOSPRayTextureCache
+///
+/// Delegate wide cache of loaded textures.  All materials and lights
+/// requesting the same key share one texture.  Textures no longer used by
+/// any of them stay cached while the total texel memory fits the budget of
+/// HdOSPRayConfig::textureCacheSize, and are evicted least recently used
+/// first beyond it.
+///
+/// Asynchronously requested textures are decoded on a background arena and
+/// start out as a 1x1 placeholder texture.  CommitLoadedTextures swaps the
+/// decoded texels into the placeholder, which keeps its OSPRay handle, so
+/// materials referencing it need no update.  Placeholders of textures that
+/// fail to decode are dropped instead, and the materials using them have to
+/// be synced again.
+///
+class HdOSPRayTextureCache {
+public:
+    ~HdOSPRayTextureCache();
+
+    /// Returns the texture for \p key, loading it on first use.  Returns
+    /// null if the file could not be loaded, also if a background load of
+    /// it failed and the file did not change since.  Thread safe.
+    ///   \param async if set and HdOSPRayConfig::asyncTextureLoading is
+    ///   enabled, returns a placeholder and decodes the file in the background
+    HdOSPRayCachedTexturePtr GetTexture(HdOSPRayTextureKey const& key,
+                                        bool async = false);
+
+    /// Commits textures decoded since the last call and drops those that
+    /// failed to decode.  Must not be called while a frame renders.
+    /// Returns true if any texture changed.
+    ///   \param failed set if a texture failed to decode, the materials
+    ///   using its placeholder need to be synced again
+    bool CommitLoadedTextures(bool& failed);
+
+    /// Whether textures are still decoding or waiting to be committed
+    bool HasPendingLoads() const;
+
+    /// Evicts unused textures until the cache fits its budget.  Frames may
+    /// still render with the texels of textures released by materials since
+    /// they started, so it must not be called while a frame renders.
+    void Trim();
+
+private:
+    using _TexturePtr = std::shared_ptr<HdOSPRayCachedTexture>;
+
+    // decodes the texels of key, or maps them from the on-disk cache.  UDIM
+    // sets are decoded into udimLayout if set.
+    static bool _DecodeTexels(HdOSPRayTextureKey const& key,
+                              HdOSPRayTexels& texels,
+                              HdOSPRayUDIMLayout const* udimLayout = nullptr);
+    static _TexturePtr _LoadTexture(HdOSPRayTextureKey const& key);
+    static _TexturePtr _CreatePlaceholder(HdOSPRayTextureKey const& key);
+
+    void _Trim();
+
+    struct _Entry {
+        _TexturePtr texture;
+        size_t lastUse { 0 };
+    };
+
+    struct _LoadedTexture {
+        _TexturePtr texture;
+        HdOSPRayTexels texels;
+        bool nearestFilter { false };
+    };
+
+    struct _FailedTexture {
+        HdOSPRayTextureKey key;
+        _TexturePtr texture;
+    };
+
+    mutable std::mutex _mutex;
+    std::unordered_map<HdOSPRayTextureKey, _Entry, HdOSPRayTextureKey::Hash>
+           _textures;
+    size_t _useCounter { 0 };
+    size_t _memoryUsage { 0 };
+
+    // decoded and failed textures waiting for CommitLoadedTextures
+    std::vector<_LoadedTexture> _loaded;
+    std::vector<_FailedTexture> _failed;
+    // modification time of the files of committed failed loads
+    std::unordered_map<HdOSPRayTextureKey, double, HdOSPRayTextureKey::Hash>
+           _failedLoads;
+    std::atomic<int> _numLoading { 0 };
+    tbb::task_arena _loadArena;
+    tbb::task_group _loadTasks;
+};
\ No newline at end of file